@@ -131,6 +131,112 @@ DRESULT disk_ioctl (
 }
 
 
+#if FF_DISK_VEC
+/**
+  * @brief  Reads Sector(s) into scattered buffers in a request
+  * @param  pdrv: Physical drive number (0..)
+  * @param  *seg: Array of the segments (sector, buffer and number of sectors)
+  * @param  nseg: Number of the segments
+  * @retval DRESULT: Operation result (RES_PARERR if the driver does not support it)
+  */
+DRESULT disk_readv (
+	BYTE pdrv,		/* Physical drive nmuber to identify the drive */
+	const DSEG *seg,	/* Segments to be read */
+	UINT nseg		/* Number of segments */
+)
+{
+  DRESULT res = RES_PARERR;
+
+  if (disk.drv[pdrv]->disk_readv)
+  {
+    res = disk.drv[pdrv]->disk_readv(disk.lun[pdrv], seg, nseg);
+  }
+  return res;
+}
+
+/**
+  * @brief  Writes Sector(s) from scattered buffers in a request
+  * @param  pdrv: Physical drive number (0..)
+  * @param  *seg: Array of the segments (sector, buffer and number of sectors)
+  * @param  nseg: Number of the segments
+  * @retval DRESULT: Operation result (RES_PARERR if the driver does not support it)
+  */
+DRESULT disk_writev (
+	BYTE pdrv,		/* Physical drive nmuber to identify the drive */
+	const DSEG *seg,	/* Segments to be written */
+	UINT nseg		/* Number of segments */
+)
+{
+  DRESULT res = RES_PARERR;
+
+  if (disk.drv[pdrv]->disk_writev)
+  {
+    res = disk.drv[pdrv]->disk_writev(disk.lun[pdrv], seg, nseg);
+  }
+  return res;
+}
+#endif
+
+
+#if FF_USE_ASYNC
+/**
+  * @brief  Starts to read Sector(s) without waiting for the completion
+  * @param  pdrv: Physical drive number (0..)
+  * @param  *buff: Data buffer to store read data
+  * @param  sector: Sector address (LBA)
+  * @param  count: Number of sectors to read (1..128)
+  * @param  func: Function to be called by the driver on completion
+  * @param  ctx: Argument passed to the completion function
+  * @retval DRESULT: Operation result (RES_PARERR if the driver does not support it)
+  */
+DRESULT disk_read_async (
+	BYTE pdrv,		/* Physical drive nmuber to identify the drive */
+	BYTE *buff,		/* Data buffer to store read data */
+	LBA_t sector,   /* Sector address in LBA */
+	UINT count,		/* Number of sectors to read */
+	DCPLT func,		/* Completion function */
+	void *ctx		/* Argument of the completion function */
+)
+{
+  DRESULT res = RES_PARERR;
+
+  if (disk.drv[pdrv]->disk_read_async)
+  {
+    res = disk.drv[pdrv]->disk_read_async(disk.lun[pdrv], buff, sector, count, func, ctx);
+  }
+  return res;
+}
+
+/**
+  * @brief  Starts to write Sector(s) without waiting for the completion
+  * @param  pdrv: Physical drive number (0..)
+  * @param  *buff: Data to be written
+  * @param  sector: Sector address (LBA)
+  * @param  count: Number of sectors to write (1..128)
+  * @param  func: Function to be called by the driver on completion
+  * @param  ctx: Argument passed to the completion function
+  * @retval DRESULT: Operation result (RES_PARERR if the driver does not support it)
+  */
+DRESULT disk_write_async (
+	BYTE pdrv,		/* Physical drive nmuber to identify the drive */
+	const BYTE *buff,	/* Data to be written */
+	LBA_t sector,		/* Sector address in LBA */
+	UINT count,		/* Number of sectors to write */
+	DCPLT func,		/* Completion function */
+	void *ctx		/* Argument of the completion function */
+)
+{
+  DRESULT res = RES_PARERR;
+
+  if (disk.drv[pdrv]->disk_write_async)
+  {
+    res = disk.drv[pdrv]->disk_write_async(disk.lun[pdrv], buff, sector, count, func, ctx);
+  }
+  return res;
+}
+#endif
+
+
 /**
   * @brief  Gets Time from RTC
   * @param  None
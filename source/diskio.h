@@ -34,6 +34,26 @@ DRESULT disk_read (BYTE pdrv, BYTE* buff, LBA_t sector, UINT count);
 DRESULT disk_write (BYTE pdrv, const BYTE* buff, LBA_t sector, UINT count);
 DRESULT disk_ioctl (BYTE pdrv, BYTE cmd, void* buff);
 
+#if FF_DISK_VEC
+/* Segment of the scatter-gather request */
+typedef struct {
+	LBA_t	sector;		/* Start sector number */
+	BYTE*	buff;		/* Data buffer to store read data or data to be written */
+	UINT	count;		/* Number of sectors */
+} DSEG;
+
+DRESULT disk_readv (BYTE pdrv, const DSEG* seg, UINT nseg);
+DRESULT disk_writev (BYTE pdrv, const DSEG* seg, UINT nseg);
+#endif
+
+#if FF_USE_ASYNC
+/* Completion function of the asynchronous transfer (called by the driver) */
+typedef void (*DCPLT)(void* ctx, DRESULT res);
+
+DRESULT disk_read_async (BYTE pdrv, BYTE* buff, LBA_t sector, UINT count, DCPLT func, void* ctx);
+DRESULT disk_write_async (BYTE pdrv, const BYTE* buff, LBA_t sector, UINT count, DCPLT func, void* ctx);
+#endif
+
 
 /* Disk Status Bits (DSTATUS) */
 
@@ -40,6 +40,15 @@ __ALIGN_BEGIN static uint8_t scratch[BLOCKSIZE] __ALIGN_END;
 /* Disk status */
 static volatile DSTATUS Stat = STA_NOINIT;
 static osMessageQueueId_t SDQueueID = NULL;
+#if FF_USE_ASYNC
+/* Pending asynchronous transfer */
+static DCPLT AsyncFunc = NULL;
+static void *AsyncCtx;
+static BYTE *AsyncBuff;
+static UINT AsyncCount;
+static volatile uint32_t AsyncTick;
+static osTimerId_t AsyncTimerID = NULL;
+#endif
 
 /* Private function prototypes -----------------------------------------------*/
 static int SD_check_status_with_timeout (uint32_t);
@@ -49,6 +58,12 @@ static DSTATUS SD_DMA_status (BYTE);
 static DRESULT SD_DMA_read (BYTE, BYTE*, LBA_t, UINT);
 static DRESULT SD_DMA_write (BYTE, const BYTE*, LBA_t, UINT);
 static DRESULT SD_DMA_ioctl (BYTE, BYTE, void*);
+#if FF_USE_ASYNC
+static DRESULT SD_DMA_read_async (BYTE, BYTE*, LBA_t, UINT, DCPLT, void*);
+static DRESULT SD_DMA_write_async (BYTE, const BYTE*, LBA_t, UINT, DCPLT, void*);
+static void SD_async_complete (DRESULT);
+static void SD_async_timeout (void*);
+#endif
 
 const Diskio_drvTypeDef SD_DMA_Driver =
 {
@@ -56,7 +71,11 @@ const Diskio_drvTypeDef SD_DMA_Driver =
   SD_DMA_status,
   SD_DMA_read,
   SD_DMA_write,
-  SD_DMA_ioctl
+  SD_DMA_ioctl,
+#if FF_USE_ASYNC
+  SD_DMA_read_async,
+  SD_DMA_write_async
+#endif
 };
 
 /* Private functions ---------------------------------------------------------*/
@@ -132,6 +151,18 @@ static DSTATUS SD_DMA_initialize(BYTE lun)
       {
         Stat |= STA_NOINIT;
       }
+#if FF_USE_ASYNC
+      /* the timer terminates an asynchronous transfer never completed */
+      if (AsyncTimerID == NULL)
+      {
+        AsyncTimerID = osTimerNew(SD_async_timeout, osTimerOnce, NULL, NULL);
+      }
+
+      if (AsyncTimerID == NULL)
+      {
+        Stat |= STA_NOINIT;
+      }
+#endif
     }
   }
 
@@ -389,6 +420,157 @@ static DRESULT SD_DMA_ioctl(BYTE lun, BYTE cmd, void *buff)
   return res;
 }
 
+#if FF_USE_ASYNC
+/**
+ * @brief  Start to read data from sd card into a buffer
+ * @param  lun : not used
+ * @param  *buff: Data buffer to store read data
+ * @param  sector: Sector address (LBA)
+ * @param  count: Number of sectors to read (1..128)
+ * @param  func: Function to be called on completion
+ * @param  ctx: Argument passed to the completion function
+ * @retval DRESULT: return RES_OK if the transfer is started, RES_PARERR if it
+ *         needs to be done by SD_DMA_read() and RES_ERROR otherwise
+ */
+static DRESULT SD_DMA_read_async(BYTE lun, BYTE *buff, LBA_t sector, UINT count, DCPLT func, void *ctx)
+{
+  /* The DMA needs a buffer aligned on 32 bytes, leave others to the slow path of SD_DMA_read() */
+  if (((uint32_t)buff & 0x1F) || AsyncFunc != NULL)
+  {
+    return RES_PARERR;
+  }
+
+  if (SD_check_status_with_timeout(SD_TIMEOUT) < 0)
+  {
+    return RES_ERROR;
+  }
+
+  AsyncCtx = ctx;
+  AsyncBuff = buff;
+  AsyncCount = count;
+  AsyncTick = osKernelGetTickCount();
+  AsyncFunc = func;
+  if (HAL_SD_ReadBlocks_DMA(&sdmmc_handle, (uint8_t*)buff, sector, count) != HAL_OK)
+  {
+    AsyncFunc = NULL;
+    return RES_ERROR;
+  }
+  osTimerStart(AsyncTimerID, SD_TIMEOUT);
+
+  return RES_OK;
+}
+
+/**
+ * @brief  Start to write data from a buffer into sd card
+ * @param  lun : not used
+ * @param  *buff: Data to be written
+ * @param  sector: Sector address (LBA)
+ * @param  count: Number of sectors to write (1..128)
+ * @param  func: Function to be called on completion
+ * @param  ctx: Argument passed to the completion function
+ * @retval DRESULT: return RES_OK if the transfer is started, RES_PARERR if it
+ *         needs to be done by SD_DMA_write() and RES_ERROR otherwise
+ */
+static DRESULT SD_DMA_write_async(BYTE lun, const BYTE *buff, LBA_t sector, UINT count, DCPLT func, void *ctx)
+{
+  /* The DMA needs a buffer aligned on 32 bytes, leave others to the slow path of SD_DMA_write() */
+  if (((uint32_t)buff & 0x1F) || AsyncFunc != NULL)
+  {
+    return RES_PARERR;
+  }
+
+  if (SD_check_status_with_timeout(SD_TIMEOUT) < 0)
+  {
+    return RES_ERROR;
+  }
+
+#if (ENABLE_SD_DMA_CACHE_MAINTENANCE == 1)
+  SCB_CleanDCache_by_Addr((uint32_t*)buff, count*BLOCKSIZE);
+#endif
+
+  AsyncCtx = ctx;
+  AsyncBuff = NULL;
+  AsyncCount = count;
+  AsyncTick = osKernelGetTickCount();
+  AsyncFunc = func;
+  if (HAL_SD_WriteBlocks_DMA(&sdmmc_handle, (uint8_t*)buff, sector, count) != HAL_OK)
+  {
+    AsyncFunc = NULL;
+    return RES_ERROR;
+  }
+  osTimerStart(AsyncTimerID, SD_TIMEOUT);
+
+  return RES_OK;
+}
+
+/**
+ * @brief  Notify the completion of the asynchronous transfer
+ * @param  res: Result of the transfer
+ * @retval None
+ */
+static void SD_async_complete(DRESULT res)
+{
+  DCPLT func = AsyncFunc;
+
+#if (ENABLE_SD_DMA_CACHE_MAINTENANCE == 1)
+  if (res == RES_OK && AsyncBuff != NULL)
+  {
+    /* get the actual data of the read transfer instead of the cached one */
+    SCB_InvalidateDCache_by_Addr((uint32_t*)AsyncBuff, AsyncCount*BLOCKSIZE);
+  }
+#endif
+  /*
+   * the card may still be busy after the transfer, it is checked at the top
+   * of the next operation
+   */
+  AsyncFunc = NULL;
+  func(AsyncCtx, res);
+}
+
+/**
+ * @brief  Terminate the asynchronous transfer not completed in SD_TIMEOUT
+ * @param  argument: not used
+ * @retval None
+ */
+static void SD_async_timeout(void *argument)
+{
+  DCPLT func = NULL;
+
+  /*
+   * the scheduler is locked to prevent a new transfer from being started
+   * meanwhile, the completion interrupt can still come before the abort
+   */
+  osKernelLock();
+  if (AsyncFunc != NULL && osKernelGetTickCount() - AsyncTick >= SD_TIMEOUT)
+  {
+    HAL_SD_Abort(&sdmmc_handle);
+    /* no completion callback after the abort, take the one still pending */
+    func = AsyncFunc;
+    AsyncFunc = NULL;
+  }
+  osKernelUnlock();
+
+  if (func != NULL)
+  {
+    func(AsyncCtx, RES_ERROR);
+  }
+}
+
+/**
+ * @brief  Fail the asynchronous transfer on an SD error
+ * @note   The application calls it from its HAL_SD_ErrorCallback()
+ * @param  None
+ * @retval None
+ */
+void SD_DMA_AsyncErrorCallback(void)
+{
+  if (AsyncFunc != NULL)
+  {
+    SD_async_complete(RES_ERROR);
+  }
+}
+#endif
+
 /**
   * @brief Tx Transfer completed callbacks
   * @param hsd: SD handle
@@ -397,6 +579,13 @@ static DRESULT SD_DMA_ioctl(BYTE lun, BYTE cmd, void *buff)
 
 void HAL_SD_TxCpltCallback(SD_HandleTypeDef *hsd)
 {
+#if FF_USE_ASYNC
+  if (AsyncFunc != NULL)
+  {
+    SD_async_complete(RES_OK);
+    return;
+  }
+#endif
   /*
    * No need to add an "osKernelRunning()" check here, as the SD_initialize()
    * is always called before any SD_Read()/SD_Write() call
@@ -407,6 +596,13 @@ void HAL_SD_TxCpltCallback(SD_HandleTypeDef *hsd)
 
 void HAL_SD_RxCpltCallback(SD_HandleTypeDef *hsd)
 {
+#if FF_USE_ASYNC
+  if (AsyncFunc != NULL)
+  {
+    SD_async_complete(RES_OK);
+    return;
+  }
+#endif
   /*
    * No need to add an "osKernelRunning()" check here, as the SD_initialize()
    * is always called before any SD_Read()/SD_Write() call
@@ -37,6 +37,10 @@
 /* Exported constants --------------------------------------------------------*/
 /* Exported functions ------------------------------------------------------- */
 extern const Diskio_drvTypeDef SD_DMA_Driver;
+#if FF_USE_ASYNC
+/* to be called from HAL_SD_ErrorCallback() of the application */
+void SD_DMA_AsyncErrorCallback(void);
+#endif
 
 #ifdef __cplusplus
 }
@@ -264,6 +264,15 @@
 #else
 #define SS(fs)	((fs)->ssize)	/* Variable sector size */
 #endif
+#if !FF_FS_TINY && FF_FIL_BUF < 1
+#error Wrong FF_FIL_BUF setting
+#endif
+#if FF_FREE_MAP % 4
+#error Wrong FF_FREE_MAP setting
+#endif
+#if FF_DIR_HINT < 0 || FF_DIR_HINT > 255
+#error Wrong FF_DIR_HINT setting
+#endif
 
 
 /* Timestamp */
@@ -515,6 +524,12 @@ static const BYTE GUID_MS_Basic[16] = {0xA2,0xA0,0xD0,0xEB,0xE5,0xB9,0x33,0x44,0
 #error Wrong setting of FF_LFN_UNICODE
 #endif
 static const BYTE LfnOfs[] = {1,3,5,7,9,14,16,18,20,22,24,28,30};	/* FAT: Offset of LFN characters in the directory entry */
+static const BYTE ChrCls[] = {	/* Class of ASCII characters in the file name (1:illegal for LFN, 2:illegal for SFN) */
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 1, 0, 0, 0, 0, 0, 0, 0, 1, 2, 2, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 2, 1, 2, 1, 1,	/*  !"#$%&'()*+,-./0123456789:;<=>? */
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 2, 0, 2, 0, 0,	/* @ABCDEFGHIJKLMNOPQRSTUVWXYZ[\]^_ */
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 0, 0, 1	/* `abcdefghijklmnopqrstuvwxyz{|}~  */
+};
 #define MAXDIRB(nc)	((nc + 44U) / 15 * SZDIRE)	/* exFAT: Size of directory entry block scratchpad buffer needed for the name length */
 
 #if FF_USE_LFN == 1		/* LFN enabled with static working buffer */
@@ -785,12 +800,12 @@ static DWORD tchar2uni (	/* Returns a character in UTF-16 encoding (>=0x10000 on
 	WCHAR wc;
 
 	wc = (BYTE)*p++;			/* Get a byte */
-	if (dbc_1st((BYTE)wc)) {	/* Is it a DBC 1st byte? */
-		b = (BYTE)*p++;			/* Get 2nd byte */
-		if (!dbc_2nd(b)) return 0xFFFFFFFF;	/* Invalid code? */
-		wc = (wc << 8) + b;		/* Make a DBC */
-	}
-	if (wc != 0) {
+	if (wc >= 0x80) {			/* Not an ASCII character? (ASCII is identical in Unicode) */
+		if (dbc_1st((BYTE)wc)) {	/* Is it a DBC 1st byte? */
+			b = (BYTE)*p++;			/* Get 2nd byte */
+			if (!dbc_2nd(b)) return 0xFFFFFFFF;	/* Invalid code? */
+			wc = (wc << 8) + b;		/* Make a DBC */
+		}
 		wc = ff_oem2uni(wc, CODEPAGE);	/* ANSI/OEM ==> Unicode */
 		if (wc == 0) return 0xFFFFFFFF;	/* Invalid code? */
 	}
@@ -873,7 +888,7 @@ static UINT put_utf (	/* Returns number of encoding units written (0:buffer over
 #else						/* ANSI/OEM output */
 	WCHAR wc;
 
-	wc = ff_uni2oem(chr, CODEPAGE);
+	wc = (chr < 0x80) ? (WCHAR)chr : ff_uni2oem(chr, CODEPAGE);	/* Unicode ==> ANSI/OEM (ASCII is identical) */
 	if (wc >= 0x100) {	/* Is this a DBC? */
 		if (szb < 2) return 0;
 		*buf++ = (char)(wc >> 8);	/* Store DBC 1st byte */
@@ -1050,10 +1065,101 @@ static void clear_share (	/* Clear all lock entries of the volume */
 
 
 
+#if FF_DISK_VEC
+/*-----------------------------------------------------------------------*/
+/* Transfer scattered sectors and buffers in a request                   */
+/*-----------------------------------------------------------------------*/
+
+static DRESULT xfer_vec (	/* Returns the result of the disk I/O */
+	FATFS* fs,			/* Filesystem object */
+	const DSEG* seg,	/* Segments to be transferred */
+	UINT ns,			/* Number of segments */
+	int wr				/* 0:Read, 1:Write */
+)
+{
+	DRESULT res;
+	UINT i;
+
+
+	if (ns >= 2) {	/* Try a scatter-gather request */
+		res = wr ? disk_writev(fs->pdrv, seg, ns) : disk_readv(fs->pdrv, seg, ns);
+		if (res != RES_PARERR) return res;	/* Done or hard error? (RES_PARERR:not supported by the disk I/O layer) */
+	}
+	for (i = 0, res = RES_OK; i < ns && res == RES_OK; i++) {	/* Transfer the segments one by one */
+		res = wr ? disk_write(fs->pdrv, seg[i].buff, seg[i].sector, seg[i].count) : disk_read(fs->pdrv, seg[i].buff, seg[i].sector, seg[i].count);
+	}
+	return res;
+}
+#endif
+
+
+
+
 /*-----------------------------------------------------------------------*/
 /* Move/Flush disk access window in the filesystem object                */
 /*-----------------------------------------------------------------------*/
 #if !FF_FS_READONLY
+#if FF_LAZY_FAT2
+static int defer_mirror (	/* 1:Registered, 0:Pending list is full */
+	FATFS* fs,		/* Filesystem object */
+	DWORD ofs		/* FAT sector offset to be reflected to the 2nd FAT later */
+)
+{
+	UINT i, n = fs->n_mirror;
+
+
+	for (i = 0; i < n && fs->mirror[i] < ofs; i++) ;	/* Find the position in ascending order */
+	if (i < n && fs->mirror[i] == ofs) return 1;	/* Already registered? */
+	if (n == FF_LAZY_FAT2) return 0;	/* No room? */
+	for ( ; n > i; n--) fs->mirror[n] = fs->mirror[n - 1];	/* Insert the sector */
+	fs->mirror[i] = ofs;
+	fs->n_mirror++;
+	return 1;
+}
+#endif
+
+
+static FRESULT write_sect (	/* Returns FR_OK or FR_DISK_ERR */
+	FATFS* fs,			/* Filesystem object */
+	const BYTE* buff,	/* Sector data to be written */
+	LBA_t sect			/* Sector to be written back */
+)
+{
+#if FF_DISK_VEC
+	DSEG seg[2];
+
+
+	if (sect - fs->fatbase < fs->fsize && fs->n_fats == 2	/* Is it in the 1st FAT to be reflected to the 2nd FAT now? */
+#if FF_LAZY_FAT2
+		&& !defer_mirror(fs, (DWORD)(sect - fs->fatbase))
+#endif
+		) {
+		seg[0].sector = sect; seg[0].buff = (BYTE*)buff; seg[0].count = 1;
+		seg[1].sector = sect + fs->fsize; seg[1].buff = (BYTE*)buff; seg[1].count = 1;
+		if (xfer_vec(fs, seg, 2, 1) != RES_OK) return FR_DISK_ERR;	/* Write it into the both FATs in a request */
+#if FF_READAHEAD
+		if (sect - fs->rasect < fs->racnt) fs->racnt = 0;	/* Discard the stale read-ahead data */
+#endif
+		return FR_OK;
+	}
+#endif
+	if (disk_write(fs->pdrv, buff, sect, 1) != RES_OK) return FR_DISK_ERR;	/* Write it back into the volume */
+#if FF_READAHEAD
+	if (sect - fs->rasect < fs->racnt) fs->racnt = 0;	/* Discard the stale read-ahead data */
+#endif
+	if (sect - fs->fatbase < fs->fsize) {	/* Is it in the 1st FAT? */
+#if FF_LAZY_FAT2
+		if (fs->n_fats == 2 && !defer_mirror(fs, (DWORD)(sect - fs->fatbase))) {	/* Reflect it to 2nd FAT at sync if possible */
+#else
+		if (fs->n_fats == 2) {
+#endif
+			disk_write(fs->pdrv, buff, sect + fs->fsize, 1);	/* Reflect it to 2nd FAT if needed */
+		}
+	}
+	return FR_OK;
+}
+
+
 static FRESULT sync_window (	/* Returns FR_OK or FR_DISK_ERR */
 	FATFS* fs			/* Filesystem object */
 )
@@ -1062,20 +1168,126 @@ static FRESULT sync_window (	/* Returns FR_OK or FR_DISK_ERR */
 
 
 	if (fs->wflag) {	/* Is the disk access window dirty? */
-		if (disk_write(fs->pdrv, fs->win, fs->winsect, 1) == RES_OK) {	/* Write it back into the volume */
-			fs->wflag = 0;	/* Clear window dirty flag */
-			if (fs->winsect - fs->fatbase < fs->fsize) {	/* Is it in the 1st FAT? */
-				if (fs->n_fats == 2) disk_write(fs->pdrv, fs->win, fs->winsect + fs->fsize, 1);	/* Reflect it to 2nd FAT if needed */
-			}
-		} else {
-			res = FR_DISK_ERR;
-		}
+		res = write_sect(fs, fs->win, fs->winsect);	/* Write it back into the volume */
+		if (res == FR_OK) fs->wflag = 0;	/* Clear window dirty flag */
 	}
 	return res;
 }
 #endif
 
 
+#if FF_WIN_CACHE
+/* Sectors swapped out of the window are kept in the window cache. A sector is never held */
+/* in both the window and the cache, so the window keeps its own dirty flag as usual. */
+
+static FRESULT swap_window (	/* Returns FR_OK or FR_DISK_ERR (window is empty or holds the sector on FR_OK) */
+	FATFS* fs,		/* Filesystem object */
+	LBA_t sect		/* Sector LBA to make appearance in the fs->win[] */
+)
+{
+	UINT i, n;
+	LBA_t sc;
+	BYTE *p, b, f;
+
+
+	for (i = 0; i < FF_WIN_CACHE && fs->csect[i] != sect; i++) ;	/* Find the sector in the cache */
+	if (i < FF_WIN_CACHE) {	/* Cache hit? Exchange the window and the cache slot */
+		p = fs->cbuf[i];
+		for (n = 0; n < SS(fs); n++) {
+			b = fs->win[n]; fs->win[n] = p[n]; p[n] = b;
+		}
+		sc = fs->winsect; fs->winsect = sect; fs->csect[i] = sc;
+		f = fs->wflag; fs->wflag = fs->cflag[i]; fs->cflag[i] = f;
+		fs->cage[i] = fs->ctick++;
+		return FR_OK;
+	}
+	if (fs->winsect == (LBA_t)0 - 1) return FR_OK;	/* Nothing to be swapped out? */
+
+	for (i = n = 0; i < FF_WIN_CACHE; i++) {	/* Select a slot to store the window, blank slot or LRU slot */
+		if (fs->csect[i] == (LBA_t)0 - 1) {
+			n = i; break;
+		}
+		if (fs->ctick - fs->cage[i] > fs->ctick - fs->cage[n]) n = i;
+	}
+#if !FF_FS_READONLY
+	if (fs->cflag[n]) {	/* Write-back the evicted sector if it is dirty */
+		if (write_sect(fs, fs->cbuf[n], fs->csect[n]) != FR_OK) return FR_DISK_ERR;
+		fs->cflag[n] = 0;
+	}
+#endif
+	memcpy(fs->cbuf[n], fs->win, SS(fs));	/* Move the window to the slot */
+	fs->csect[n] = fs->winsect; fs->cflag[n] = fs->wflag;
+	fs->cage[n] = fs->ctick++;
+	fs->winsect = (LBA_t)0 - 1; fs->wflag = 0;	/* The window is empty */
+	return FR_OK;
+}
+
+
+#if !FF_FS_READONLY
+static FRESULT sync_cache (	/* Returns FR_OK or FR_DISK_ERR */
+	FATFS* fs		/* Filesystem object */
+)
+{
+	UINT i;
+
+
+	for (i = 0; i < FF_WIN_CACHE; i++) {	/* Write-back dirty sectors in the window cache */
+		if (fs->cflag[i]) {
+			if (write_sect(fs, fs->cbuf[i], fs->csect[i]) != FR_OK) return FR_DISK_ERR;
+			fs->cflag[i] = 0;
+		}
+	}
+	return FR_OK;
+}
+#endif
+#endif	/* FF_WIN_CACHE */
+
+
+#if FF_WIN_CACHE || FF_READAHEAD
+static void inval_cache (
+	FATFS* fs,		/* Filesystem object */
+	LBA_t sect,		/* Top of the sectors to be discarded from the window cache and read-ahead buffer */
+	UINT cnt		/* Number of sectors (0:entire cache) */
+)
+{
+#if FF_WIN_CACHE
+	UINT i;
+
+
+	for (i = 0; i < FF_WIN_CACHE; i++) {
+		if (cnt == 0 || fs->csect[i] - sect < cnt) {
+			fs->csect[i] = (LBA_t)0 - 1; fs->cflag[i] = 0;
+		}
+	}
+#endif
+#if FF_READAHEAD
+	if (cnt == 0 || (fs->racnt != 0 && (sect - fs->rasect < fs->racnt || fs->rasect - sect < cnt))) {	/* Overlapped with the read-ahead buffer? */
+		fs->racnt = 0;
+	}
+#endif
+}
+#endif
+
+
+#if FF_READAHEAD
+static DRESULT read_sect (	/* Returns the result of disk_read */
+	FATFS* fs,		/* Filesystem object */
+	BYTE* buff,		/* Buffer to store the sector data */
+	LBA_t sect		/* Sector to be read */
+)
+{
+	if (sect - fs->rasect < fs->racnt) {	/* Is the sector in the read-ahead buffer? */
+		memcpy(buff, fs->rabuf + (sect - fs->rasect) * SS(fs), SS(fs));
+		fs->rahit = 1;
+		return RES_OK;
+	}
+	return disk_read(fs->pdrv, buff, sect, 1);
+}
+#else
+#define read_sect(fs, buff, sect) disk_read((fs)->pdrv, buff, sect, 1)
+#endif
+
+
 static FRESULT move_window (	/* Returns FR_OK or FR_DISK_ERR */
 	FATFS* fs,		/* Filesystem object */
 	LBA_t sect		/* Sector LBA to make appearance in the fs->win[] */
@@ -1085,11 +1297,16 @@ static FRESULT move_window (	/* Returns FR_OK or FR_DISK_ERR */
 
 
 	if (sect != fs->winsect) {	/* Window offset changed? */
+#if FF_WIN_CACHE
+		res = swap_window(fs, sect);	/* Swap out the window and swap in the sector if cached */
+		if (res == FR_OK && sect != fs->winsect) {	/* Fill sector window with new data if not cached */
+#else
 #if !FF_FS_READONLY
 		res = sync_window(fs);		/* Flush the window */
 #endif
 		if (res == FR_OK) {			/* Fill sector window with new data */
-			if (disk_read(fs->pdrv, fs->win, sect, 1) != RES_OK) {
+#endif
+			if (read_sect(fs, fs->win, sect) != RES_OK) {
 				sect = (LBA_t)0 - 1;	/* Invalidate window if read data is not valid */
 				res = FR_DISK_ERR;
 			}
@@ -1101,6 +1318,147 @@ static FRESULT move_window (	/* Returns FR_OK or FR_DISK_ERR */
 
 
 
+/*-----------------------------------------------------------------------*/
+/* FAT access - Get the FAT/bitmap sector into the memory               */
+/*-----------------------------------------------------------------------*/
+#if FF_FAT_CACHE
+/* FAT and allocation bitmap sectors are held in the FAT cache separated from the window, */
+/* so that walking the cluster chain does not push out the directory sectors. */
+
+static void inval_fatcache (
+	FATFS* fs		/* Filesystem object */
+)
+{
+	UINT i;
+
+
+	for (i = 0; i < FF_FAT_CACHE; i++) {
+		fs->fsect[i] = (LBA_t)0 - 1; fs->fflag[i] = 0;
+	}
+}
+
+
+#if !FF_FS_READONLY
+static FRESULT sync_fatcache (	/* Returns FR_OK or FR_DISK_ERR */
+	FATFS* fs		/* Filesystem object */
+)
+{
+	UINT i;
+
+
+	for (i = 0; i < FF_FAT_CACHE; i++) {	/* Write-back dirty sectors in the FAT cache (reflected to 2nd FAT) */
+		if (fs->fflag[i]) {
+			if (write_sect(fs, fs->fbuf[i], fs->fsect[i]) != FR_OK) return FR_DISK_ERR;
+			fs->fflag[i] = 0;
+		}
+	}
+	return FR_OK;
+}
+#endif
+#endif	/* FF_FAT_CACHE */
+
+
+static BYTE* fat_window (	/* Returns pointer to the sector data (null:disk error) */
+	FATFS* fs,		/* Filesystem object */
+	LBA_t sect,		/* FAT or bitmap sector to be accessed */
+	int wr			/* Mark the sector dirty (1:going to be changed) */
+)
+{
+#if FF_FAT_CACHE
+	UINT i, n;
+
+
+	for (i = 0; i < FF_FAT_CACHE && fs->fsect[i] != sect; i++) ;	/* Find the sector in the FAT cache */
+	if (i == FF_FAT_CACHE) {	/* Not in the cache? */
+		for (i = n = 0; n < FF_FAT_CACHE; n++) {	/* Select a slot to be used, blank slot or LRU slot */
+			if (fs->fsect[n] == (LBA_t)0 - 1) {
+				i = n; break;
+			}
+			if (fs->ctick - fs->fage[n] > fs->ctick - fs->fage[i]) i = n;
+		}
+#if !FF_FS_READONLY
+		if (fs->fflag[i]) {	/* Write-back the evicted sector if it is dirty */
+			if (write_sect(fs, fs->fbuf[i], fs->fsect[i]) != FR_OK) return 0;
+			fs->fflag[i] = 0;
+		}
+#endif
+		fs->fsect[i] = (LBA_t)0 - 1;
+		if (read_sect(fs, fs->fbuf[i], sect) != RES_OK) return 0;	/* Load the sector */
+		fs->fsect[i] = sect;
+	}
+	fs->fage[i] = fs->ctick++;
+	if (wr) fs->fflag[i] = 1;
+	return fs->fbuf[i];
+
+#else
+	if (move_window(fs, sect) != FR_OK) return 0;	/* Use the window */
+	if (wr) fs->wflag = 1;
+	return fs->win;
+#endif
+}
+
+
+#if !FF_FS_READONLY && FF_FS_MINIMIZE == 0 && (FF_FAT_CACHE > 1 || FF_READAHEAD)
+static void prefetch_fat (
+	FATFS* fs,		/* Filesystem object */
+	LBA_t sect		/* FAT (FAT16/32) or bitmap sector to be accessed next in the sequential scan */
+)
+{
+	DWORD nsect;
+#if FF_FAT_CACHE > 1
+	UINT i;
+#endif
+
+
+#if FF_FS_EXFAT
+	if (fs->fs_type == FS_EXFAT) {	/* Number of sectors left in the bitmap */
+		nsect = (DWORD)(fs->bitbase + ((fs->n_fatent - 2 + 7) / 8 + SS(fs) - 1) / SS(fs) - sect);
+	} else
+#endif
+	{								/* Number of sectors left in the FAT */
+		nsect = (DWORD)(fs->fatbase + (fs->n_fatent * (fs->fs_type == FS_FAT16 ? 2 : 4) + SS(fs) - 1) / SS(fs) - sect);
+	}
+#if FF_FAT_CACHE > 1
+	for (i = 0; i < FF_FAT_CACHE && fs->fsect[i] != sect; i++) ;
+	if (i < FF_FAT_CACHE || nsect < 2 || SS(fs) != FF_MAX_SS) return;	/* Already in the cache or not worth? */
+	if (nsect > FF_FAT_CACHE) nsect = FF_FAT_CACHE;
+	if (sync_fatcache(fs) != FR_OK) return;	/* Write-back the dirty sectors to refill the entire cache */
+	inval_fatcache(fs);
+	if (disk_read(fs->pdrv, fs->fbuf[0], sect, (UINT)nsect) != RES_OK) return;	/* Load the following sectors into the cache slots at a time */
+	for (i = 0; i < nsect; i++) {
+		fs->fsect[i] = sect + i; fs->fage[i] = fs->ctick++;
+	}
+#else
+	if (sect - fs->rasect < fs->racnt || nsect < 2) return;	/* Already in the read-ahead buffer or not worth? */
+	if (nsect > FF_READAHEAD) nsect = FF_READAHEAD;
+	fs->racnt = 0;
+	if (disk_read(fs->pdrv, fs->rabuf, sect, (UINT)nsect) != RES_OK) return;	/* Load the following sectors into the read-ahead buffer */
+	fs->rasect = sect; fs->racnt = (UINT)nsect; fs->rahit = 1;
+#endif
+}
+#endif
+
+
+#if FF_LAZY_FAT2 && !FF_FS_READONLY
+static FRESULT sync_mirror (	/* Returns FR_OK or FR_DISK_ERR */
+	FATFS* fs		/* Filesystem object */
+)
+{
+	UINT i;
+	BYTE *fw;
+
+
+	for (i = 0; i < fs->n_mirror; i++) {	/* Reflect the pending FAT sectors to the 2nd FAT in ascending order */
+		fw = fat_window(fs, fs->fatbase + fs->mirror[i], 0);
+		if (!fw || disk_write(fs->pdrv, fw, fs->fatbase + fs->fsize + fs->mirror[i], 1) != RES_OK) return FR_DISK_ERR;
+	}
+	fs->n_mirror = 0;
+	return FR_OK;
+}
+#endif
+
+
+
 
 #if !FF_FS_READONLY
 /*-----------------------------------------------------------------------*/
@@ -1115,6 +1473,15 @@ static FRESULT sync_fs (	/* Returns FR_OK or FR_DISK_ERR */
 
 
 	res = sync_window(fs);
+#if FF_WIN_CACHE
+	if (res == FR_OK) res = sync_cache(fs);
+#endif
+#if FF_FAT_CACHE
+	if (res == FR_OK) res = sync_fatcache(fs);
+#endif
+#if FF_LAZY_FAT2
+	if (res == FR_OK) res = sync_mirror(fs);	/* Reflect the FAT changes to the 2nd FAT */
+#endif
 	if (res == FR_OK) {
 		if (fs->fs_type == FS_FAT32 && fs->fsi_flag == 1) {	/* FAT32: Update FSInfo sector if needed */
 			/* Create FSInfo structure */
@@ -1125,6 +1492,9 @@ static FRESULT sync_fs (	/* Returns FR_OK or FR_DISK_ERR */
 			st_dword(fs->win + FSI_Free_Count, fs->free_clst);	/* Number of free clusters */
 			st_dword(fs->win + FSI_Nxt_Free, fs->last_clst);	/* Last allocated culuster */
 			fs->winsect = fs->volbase + 1;						/* Write it into the FSInfo sector (Next to VBR) */
+#if FF_WIN_CACHE || FF_READAHEAD
+			inval_cache(fs, fs->winsect, 1);
+#endif
 			disk_write(fs->pdrv, fs->win, fs->winsect, 1);
 			fs->fsi_flag = 0;
 		}
@@ -1167,6 +1537,7 @@ static DWORD get_fat (		/* 0xFFFFFFFF:Disk error, 1:Internal error, 2..0x7FFFFFF
 {
 	UINT wc, bc;
 	DWORD val;
+	BYTE *fw;
 	FATFS *fs = obj->fs;
 
 
@@ -1179,21 +1550,21 @@ static DWORD get_fat (		/* 0xFFFFFFFF:Disk error, 1:Internal error, 2..0x7FFFFFF
 		switch (fs->fs_type) {
 		case FS_FAT12 :
 			bc = (UINT)clst; bc += bc / 2;
-			if (move_window(fs, fs->fatbase + (bc / SS(fs))) != FR_OK) break;
-			wc = fs->win[bc++ % SS(fs)];		/* Get 1st byte of the entry */
-			if (move_window(fs, fs->fatbase + (bc / SS(fs))) != FR_OK) break;
-			wc |= fs->win[bc % SS(fs)] << 8;	/* Merge 2nd byte of the entry */
+			if ((fw = fat_window(fs, fs->fatbase + (bc / SS(fs)), 0)) == 0) break;
+			wc = fw[bc++ % SS(fs)];				/* Get 1st byte of the entry */
+			if ((fw = fat_window(fs, fs->fatbase + (bc / SS(fs)), 0)) == 0) break;
+			wc |= fw[bc % SS(fs)] << 8;			/* Merge 2nd byte of the entry */
 			val = (clst & 1) ? (wc >> 4) : (wc & 0xFFF);	/* Adjust bit position */
 			break;
 
 		case FS_FAT16 :
-			if (move_window(fs, fs->fatbase + (clst / (SS(fs) / 2))) != FR_OK) break;
-			val = ld_word(fs->win + clst * 2 % SS(fs));		/* Simple WORD array */
+			if ((fw = fat_window(fs, fs->fatbase + (clst / (SS(fs) / 2)), 0)) == 0) break;
+			val = ld_word(fw + clst * 2 % SS(fs));		/* Simple WORD array */
 			break;
 
 		case FS_FAT32 :
-			if (move_window(fs, fs->fatbase + (clst / (SS(fs) / 4))) != FR_OK) break;
-			val = ld_dword(fs->win + clst * 4 % SS(fs)) & 0x0FFFFFFF;	/* Simple DWORD array but mask out upper 4 bits */
+			if ((fw = fat_window(fs, fs->fatbase + (clst / (SS(fs) / 4)), 0)) == 0) break;
+			val = ld_dword(fw + clst * 4 % SS(fs)) & 0x0FFFFFFF;	/* Simple DWORD array but mask out upper 4 bits */
 			break;
 #if FF_FS_EXFAT
 		case FS_EXFAT :
@@ -1213,8 +1584,8 @@ static DWORD get_fat (		/* 0xFFFFFFFF:Disk error, 1:Internal error, 2..0x7FFFFFF
 					if (obj->n_frag != 0) {	/* Is it on the growing edge? */
 						val = 0x7FFFFFFF;	/* Generate EOC */
 					} else {
-						if (move_window(fs, fs->fatbase + (clst / (SS(fs) / 4))) != FR_OK) break;
-						val = ld_dword(fs->win + clst * 4 % SS(fs)) & 0x7FFFFFFF;
+						if ((fw = fat_window(fs, fs->fatbase + (clst / (SS(fs) / 4)), 0)) == 0) break;
+						val = ld_dword(fw + clst * 4 % SS(fs)) & 0x7FFFFFFF;
 					}
 					break;
 				}
@@ -1233,75 +1604,335 @@ static DWORD get_fat (		/* 0xFFFFFFFF:Disk error, 1:Internal error, 2..0x7FFFFFF
 
 
 
-#if !FF_FS_READONLY
+#if FF_FREE_MAP && !FF_FS_READONLY
 /*-----------------------------------------------------------------------*/
-/* FAT access - Change value of an FAT entry                             */
+/* FAT handling - Free space map                                         */
 /*-----------------------------------------------------------------------*/
+/* The clusters are divided into groups of 2^fmshift clusters and a bit in
+/  the fmap[] is cleared when the group is found to have no free cluster.
+/  The bits are set at mount and when a cluster in the group is freed. */
 
-static FRESULT put_fat (	/* FR_OK(0):succeeded, !=0:error */
-	FATFS* fs,		/* Corresponding filesystem object */
-	DWORD clst,		/* FAT index number (cluster number) to be changed */
-	DWORD val		/* New value to be set to the entry */
+static void init_fmap (
+	FATFS* fs		/* Filesystem object */
 )
 {
-	UINT bc;
-	BYTE *p;
-	FRESULT res = FR_INT_ERR;
+	BYTE sh = 0;
 
 
-	if (clst >= 2 && clst < fs->n_fatent) {	/* Check if in valid range */
-		switch (fs->fs_type) {
-		case FS_FAT12:
-			bc = (UINT)clst; bc += bc / 2;	/* bc: byte offset of the entry */
-			res = move_window(fs, fs->fatbase + (bc / SS(fs)));
-			if (res != FR_OK) break;
-			p = fs->win + bc++ % SS(fs);
-			*p = (clst & 1) ? ((*p & 0x0F) | ((BYTE)val << 4)) : (BYTE)val;	/* Update 1st byte */
-			fs->wflag = 1;
-			res = move_window(fs, fs->fatbase + (bc / SS(fs)));
-			if (res != FR_OK) break;
-			p = fs->win + bc % SS(fs);
-			*p = (clst & 1) ? (BYTE)(val >> 4) : ((*p & 0xF0) | ((BYTE)(val >> 8) & 0x0F));	/* Update 2nd byte */
-			fs->wflag = 1;
-			break;
+	while (((fs->n_fatent - 1) >> sh) >= (DWORD)FF_FREE_MAP * 8) sh++;	/* Find the smallest group to cover the volume */
+	fs->fmshift = sh;
+	memset(fs->fmap, 0xFF, sizeof fs->fmap);	/* All groups can have a free cluster */
+}
 
-		case FS_FAT16:
-			res = move_window(fs, fs->fatbase + (clst / (SS(fs) / 2)));
-			if (res != FR_OK) break;
-			st_word(fs->win + clst * 2 % SS(fs), (WORD)val);	/* Simple WORD array */
-			fs->wflag = 1;
-			break;
 
-		case FS_FAT32:
-#if FF_FS_EXFAT
-		case FS_EXFAT:
-#endif
-			res = move_window(fs, fs->fatbase + (clst / (SS(fs) / 4)));
-			if (res != FR_OK) break;
-			if (!FF_FS_EXFAT || fs->fs_type != FS_EXFAT) {
-				val = (val & 0x0FFFFFFF) | (ld_dword(fs->win + clst * 4 % SS(fs)) & 0xF0000000);
-			}
-			st_dword(fs->win + clst * 4 % SS(fs), val);
-			fs->wflag = 1;
-			break;
-		}
+static void mark_fmap (
+	FATFS* fs,		/* Filesystem object */
+	DWORD clst,		/* Cluster in the group to be marked */
+	int st			/* 0:No free cluster, 1:Can have a free cluster */
+)
+{
+	DWORD g = clst >> fs->fmshift;
+
+
+	if (st) {
+		fs->fmap[g / 32] |= (DWORD)1 << (g % 32);
+	} else {
+		fs->fmap[g / 32] &= ~((DWORD)1 << (g % 32));
 	}
-	return res;
 }
 
-#endif /* !FF_FS_READONLY */
-
 
+static DWORD find_fmap (	/* First cluster at or after clst which can be free (>=n_fatent:Not found) */
+	FATFS* fs,		/* Filesystem object */
+	DWORD clst		/* Cluster to start to find */
+)
+{
+	DWORD g, ng, bm;
 
 
-#if FF_FS_EXFAT && !FF_FS_READONLY
-/*-----------------------------------------------------------------------*/
-/* exFAT: Accessing FAT and Allocation Bitmap                            */
-/*-----------------------------------------------------------------------*/
+	g = clst >> fs->fmshift;
+	ng = ((fs->n_fatent - 1) >> fs->fmshift) + 1;	/* Number of groups */
+	while (g < ng) {
+		bm = fs->fmap[g / 32] >> (g % 32);
+		if (bm == 0) {		/* No candidate in rest of this word? */
+			g = (g / 32 + 1) * 32;
+			continue;
+		}
+		while (!(bm & 1)) {	/* Find the candidate group in this word */
+			bm >>= 1; g++;
+		}
+		break;
+	}
+	if (g >= ng) return fs->n_fatent;
+	return (g == clst >> fs->fmshift) ? clst : g << fs->fmshift;
+}
 
-/*--------------------------------------*/
-/* Find a contiguous free cluster block */
-/*--------------------------------------*/
+
+static void scan_fmap (
+	FATFS* fs,		/* Filesystem object */
+	DWORD clst,		/* Last cluster checked in the sequential FAT scan */
+	DWORD ncl,		/* Number of clusters checked up to clst (not across the group boundary) */
+	DWORD nfree,	/* Number of free clusters in them */
+	DWORD* nused	/* Number of consecutive clusters in use up to here (to be updated) */
+)
+{
+	DWORD gs;
+
+
+	*nused = nfree ? 0 : *nused + ncl;
+	if (((clst + 1) >> fs->fmshift) != (clst >> fs->fmshift) || clst + 1 >= fs->n_fatent) {	/* Last cluster in the group? */
+		gs = clst >> fs->fmshift << fs->fmshift;	/* First cluster of the group */
+		if (gs < 2) gs = 2;
+		if (clst >= gs && *nused >= clst - gs + 1) mark_fmap(fs, clst, 0);	/* No free cluster in whole the group? */
+	}
+}
+
+#endif /* FF_FREE_MAP && !FF_FS_READONLY */
+
+
+
+
+#if FF_FREE_EXTENT && FF_USE_EXPAND && !FF_FS_READONLY
+/*-----------------------------------------------------------------------*/
+/* FAT handling - Free extent index                                      */
+/*-----------------------------------------------------------------------*/
+/* Every cluster in the blocks held in fxscl[]/fxncl[] is free. While the
+/  fxflag.0 is set, each block in the index is a whole free block and any
+/  free block out of the index is not longer than fxmax. */
+
+static void add_extent (
+	FATFS* fs,		/* Filesystem object */
+	DWORD scl,		/* Top of the free block */
+	DWORD ncl		/* Number of clusters in the free block */
+)
+{
+	UINT i, j;
+	DWORD n;
+
+
+	for (i = j = 0; i < FF_FREE_EXTENT; i++) {	/* Find a blank or the shortest entry */
+		if (fs->fxncl[i] < fs->fxncl[j]) j = i;
+	}
+	n = fs->fxncl[j];
+	if (ncl > n) {		/* Replace it if the new block is longer */
+		fs->fxscl[j] = scl; fs->fxncl[j] = ncl;
+		ncl = n;
+	}
+	if (ncl > fs->fxmax) fs->fxmax = ncl;	/* Longest block out of the index */
+}
+
+
+static void alloc_extent (	/* Remove allocated clusters from the index */
+	FATFS* fs,		/* Filesystem object */
+	DWORD scl,		/* Top of the allocated clusters */
+	DWORD ncl		/* Number of the allocated clusters */
+)
+{
+	UINT i;
+	DWORD s, e;
+
+
+	for (i = 0; i < FF_FREE_EXTENT; i++) {
+		s = fs->fxscl[i]; e = s + fs->fxncl[i];
+		if (fs->fxncl[i] == 0 || e <= scl || s >= scl + ncl) continue;	/* Not overlapped? */
+		fs->fxncl[i] = 0;	/* Remove the block and put back the rest of it */
+		if (s < scl) add_extent(fs, s, scl - s);
+		if (e > scl + ncl) add_extent(fs, scl + ncl, e - scl - ncl);
+	}
+}
+
+
+static void free_extent (	/* Put freed clusters into the index */
+	FATFS* fs,		/* Filesystem object */
+	DWORD scl,		/* Top of the freed clusters */
+	DWORD ncl		/* Number of the freed clusters */
+)
+{
+	UINT i, pi = FF_FREE_EXTENT, ni = FF_FREE_EXTENT;
+
+
+	fs->fxflag = 0;		/* The index may not have the longest blocks any longer */
+	for (i = 0; i < FF_FREE_EXTENT; i++) {	/* Find the blocks adjacent to the freed clusters */
+		if (fs->fxncl[i] == 0) continue;
+		if (fs->fxscl[i] + fs->fxncl[i] == scl) pi = i;
+		if (fs->fxscl[i] == scl + ncl) ni = i;
+	}
+	if (pi < FF_FREE_EXTENT) {			/* Append to the preceding block */
+		fs->fxncl[pi] += ncl;
+		if (ni < FF_FREE_EXTENT) {		/* Merge the following block */
+			fs->fxncl[pi] += fs->fxncl[ni];
+			fs->fxncl[ni] = 0;
+		}
+	} else if (ni < FF_FREE_EXTENT) {	/* Prepend to the following block */
+		fs->fxscl[ni] = scl;
+		fs->fxncl[ni] += ncl;
+	} else {							/* Put it as a new block */
+		add_extent(fs, scl, ncl);
+	}
+}
+
+
+static FRESULT build_extent (	/* Collect the longest free blocks on the volume */
+	FFOBJID* obj	/* Object to access the FAT */
+)
+{
+	FATFS *fs = obj->fs;
+	DWORD clst, scl = 0, stat;
+	UINT i;
+#if FF_FS_EXFAT
+	BYTE *fw;
+#endif
+#if FF_FREE_MAP
+	DWORD nused = 0;
+#endif
+
+
+	for (i = 0; i < FF_FREE_EXTENT; fs->fxncl[i++] = 0) ;	/* Clear the index */
+	fs->fxmax = 0;
+	for (clst = 2; clst < fs->n_fatent; clst++) {
+#if FF_FS_EXFAT
+		if (fs->fs_type == FS_EXFAT) {	/* exFAT: Check the allocation bitmap */
+			fw = fat_window(fs, fs->bitbase + (clst - 2) / 8 / SS(fs), 0);
+			if (!fw) return FR_DISK_ERR;
+			stat = fw[(clst - 2) / 8 % SS(fs)] & (1 << ((clst - 2) % 8));
+		} else
+#endif
+		{								/* FAT/FAT32: Check the FAT entry */
+#if FF_FREE_MAP
+			stat = find_fmap(fs, clst);	/* Skip the cluster groups with no free cluster */
+			if (stat != clst) {
+				if (scl) add_extent(fs, scl, clst - scl);
+				scl = nused = 0;
+				clst = stat - 1;
+				continue;
+			}
+#endif
+			stat = get_fat(obj, clst);
+			if (stat == 1) return FR_INT_ERR;
+			if (stat == 0xFFFFFFFF) return FR_DISK_ERR;
+#if FF_FREE_MAP
+			scan_fmap(fs, clst, 1, stat == 0, &nused);
+#endif
+		}
+		if (stat == 0) {		/* Free cluster */
+			if (scl == 0) scl = clst;
+		} else if (scl) {		/* End of a free block */
+			add_extent(fs, scl, clst - scl);
+			scl = 0;
+		}
+	}
+	if (scl) add_extent(fs, scl, fs->n_fatent - scl);
+	fs->fxflag = 1;		/* The index has the longest blocks */
+	return FR_OK;
+}
+
+
+static DWORD find_extent (	/* 0:Not found, 2..:Cluster block found, 1:Internal error, 0xFFFFFFFF:Disk error */
+	FFOBJID* obj,	/* Object to access the FAT */
+	DWORD ncl		/* Number of contiguous clusters to find (1..) */
+)
+{
+	FATFS *fs = obj->fs;
+	UINT i, j;
+	FRESULT res;
+
+
+	for (;;) {
+		for (i = 0, j = FF_FREE_EXTENT; i < FF_FREE_EXTENT; i++) {	/* Find the shortest block which fits the request */
+			if (fs->fxncl[i] >= ncl && (j == FF_FREE_EXTENT || fs->fxncl[i] < fs->fxncl[j])) j = i;
+		}
+		if (j < FF_FREE_EXTENT) return fs->fxscl[j];
+		if ((fs->fxflag & 1) && ncl > fs->fxmax) return 0;	/* No block can fit the request? */
+		res = build_extent(obj);	/* Rebuild the index and retry */
+		if (res != FR_OK) return (res == FR_DISK_ERR) ? 0xFFFFFFFF : 1;
+	}
+}
+
+#endif /* FF_FREE_EXTENT && FF_USE_EXPAND && !FF_FS_READONLY */
+
+
+
+
+#if !FF_FS_READONLY
+/*-----------------------------------------------------------------------*/
+/* FAT access - Change value of an FAT entry                             */
+/*-----------------------------------------------------------------------*/
+
+static FRESULT put_fat (	/* FR_OK(0):succeeded, !=0:error */
+	FATFS* fs,		/* Corresponding filesystem object */
+	DWORD clst,		/* FAT index number (cluster number) to be changed */
+	DWORD val		/* New value to be set to the entry */
+)
+{
+	UINT bc;
+	BYTE *p, *fw;
+	FRESULT res = FR_INT_ERR;
+
+
+	if (clst >= 2 && clst < fs->n_fatent) {	/* Check if in valid range */
+		res = FR_DISK_ERR;
+#if FF_FREE_MAP
+		if (val == 0) mark_fmap(fs, clst, 1);	/* The group gets a free cluster */
+#endif
+#if FF_FREE_EXTENT && FF_USE_EXPAND
+		if (fs->fs_type != FS_EXFAT) {	/* Update the free extent index */
+			if (val == 0) {
+				free_extent(fs, clst, 1);
+			} else {
+				alloc_extent(fs, clst, 1);
+			}
+		}
+#endif
+		switch (fs->fs_type) {
+		case FS_FAT12:
+			bc = (UINT)clst; bc += bc / 2;	/* bc: byte offset of the entry */
+			if ((fw = fat_window(fs, fs->fatbase + (bc / SS(fs)), 1)) == 0) break;
+			p = fw + bc++ % SS(fs);
+			*p = (clst & 1) ? ((*p & 0x0F) | ((BYTE)val << 4)) : (BYTE)val;	/* Update 1st byte */
+			if ((fw = fat_window(fs, fs->fatbase + (bc / SS(fs)), 1)) == 0) break;
+			p = fw + bc % SS(fs);
+			*p = (clst & 1) ? (BYTE)(val >> 4) : ((*p & 0xF0) | ((BYTE)(val >> 8) & 0x0F));	/* Update 2nd byte */
+			res = FR_OK;
+			break;
+
+		case FS_FAT16:
+			if ((fw = fat_window(fs, fs->fatbase + (clst / (SS(fs) / 2)), 1)) == 0) break;
+			st_word(fw + clst * 2 % SS(fs), (WORD)val);	/* Simple WORD array */
+			res = FR_OK;
+			break;
+
+		case FS_FAT32:
+#if FF_FS_EXFAT
+		case FS_EXFAT:
+#endif
+			if ((fw = fat_window(fs, fs->fatbase + (clst / (SS(fs) / 4)), 1)) == 0) break;
+			if (!FF_FS_EXFAT || fs->fs_type != FS_EXFAT) {
+				val = (val & 0x0FFFFFFF) | (ld_dword(fw + clst * 4 % SS(fs)) & 0xF0000000);
+			}
+			st_dword(fw + clst * 4 % SS(fs), val);
+			res = FR_OK;
+			break;
+
+		default:
+			res = FR_INT_ERR;
+		}
+	}
+	return res;
+}
+
+#endif /* !FF_FS_READONLY */
+
+
+
+
+#if FF_FS_EXFAT && !FF_FS_READONLY
+/*-----------------------------------------------------------------------*/
+/* exFAT: Accessing FAT and Allocation Bitmap                            */
+/*-----------------------------------------------------------------------*/
+
+/*--------------------------------------*/
+/* Find a contiguous free cluster block */
+/*--------------------------------------*/
 
 static DWORD find_bitmap (	/* 0:Not found, 2..:Cluster block found, 0xFFFFFFFF:Disk error */
 	FATFS* fs,	/* Filesystem object */
@@ -1309,7 +1940,7 @@ static DWORD find_bitmap (	/* 0:Not found, 2..:Cluster block found, 0xFFFFFFFF:D
 	DWORD ncl	/* Number of contiguous clusters to find (1..) */
 )
 {
-	BYTE bm, bv;
+	BYTE bm, bv, *fw;
 	UINT i;
 	DWORD val, scl, ctr;
 
@@ -1318,11 +1949,11 @@ static DWORD find_bitmap (	/* 0:Not found, 2..:Cluster block found, 0xFFFFFFFF:D
 	if (clst >= fs->n_fatent - 2) clst = 0;
 	scl = val = clst; ctr = 0;
 	for (;;) {
-		if (move_window(fs, fs->bitbase + val / 8 / SS(fs)) != FR_OK) return 0xFFFFFFFF;
+		if ((fw = fat_window(fs, fs->bitbase + val / 8 / SS(fs), 0)) == 0) return 0xFFFFFFFF;
 		i = val / 8 % SS(fs); bm = 1 << (val % 8);
 		do {
 			do {
-				bv = fs->win[i] & bm; bm <<= 1;		/* Get bit value */
+				bv = fw[i] & bm; bm <<= 1;		/* Get bit value */
 				if (++val >= fs->n_fatent - 2) {	/* Next cluster (with wrap-around) */
 					val = 0; bm = 0; i = SS(fs);
 				}
@@ -1350,22 +1981,28 @@ static FRESULT change_bitmap (
 	int bv		/* bit value to be set (0 or 1) */
 )
 {
-	BYTE bm;
+	BYTE bm, *fw;
 	UINT i;
 	LBA_t sect;
 
 
+#if FF_FREE_EXTENT && FF_USE_EXPAND
+	if (bv) {	/* Update the free extent index */
+		alloc_extent(fs, clst, ncl);
+	} else {
+		free_extent(fs, clst, ncl);
+	}
+#endif
 	clst -= 2;	/* The first bit corresponds to cluster #2 */
 	sect = fs->bitbase + clst / 8 / SS(fs);	/* Sector address */
 	i = clst / 8 % SS(fs);					/* Byte offset in the sector */
 	bm = 1 << (clst % 8);					/* Bit mask in the byte */
 	for (;;) {
-		if (move_window(fs, sect++) != FR_OK) return FR_DISK_ERR;
+		if ((fw = fat_window(fs, sect++, 1)) == 0) return FR_DISK_ERR;
 		do {
 			do {
-				if (bv == (int)((fs->win[i] & bm) != 0)) return FR_INT_ERR;	/* Is the bit expected value? */
-				fs->win[i] ^= bm;	/* Flip the bit */
-				fs->wflag = 1;
+				if (bv == (int)((fw[i] & bm) != 0)) return FR_INT_ERR;	/* Is the bit expected value? */
+				fw[i] ^= bm;	/* Flip the bit */
 				if (--ncl == 0) return FR_OK;	/* All bits processed? */
 			} while (bm <<= 1);		/* Next bit */
 			bm = 1;
@@ -1519,6 +2156,104 @@ static FRESULT remove_chain (	/* FR_OK(0):succeeded, !=0:error */
 
 
 
+#if FF_CLST_RESERVE && !FF_FS_READONLY
+/*-----------------------------------------------------------------------*/
+/* FAT handling - Cluster reservation window of the writing files        */
+/*-----------------------------------------------------------------------*/
+/* The clusters rvtop[]..rvend[]-1 follow the growing edge of the file
+/  rvobj[] and the other objects do not stretch their chains into them.
+/  The window is held only in the memory and it does not affect the
+/  volume, so that the table is a hint for the allocation and a stale
+/  entry left by an unclosed file does no harm. */
+
+static int rsv_avail (	/* 1:The cluster can be allocated to the object, 0:Reserved by another file */
+	FATFS* fs,			/* Filesystem object */
+	const FFOBJID* obj,	/* Object to allocate the cluster */
+	DWORD clst			/* Cluster to be allocated */
+)
+{
+	UINT i;
+
+
+	for (i = 0; i < FF_CLST_RSV_FILES; i++) {
+		if (fs->rvobj[i] && fs->rvobj[i] != obj && clst - fs->rvtop[i] < fs->rvend[i] - fs->rvtop[i]) return 0;
+	}
+	return 1;
+}
+
+
+static void rsv_alloc (	/* Update the window and the allocation cursor on a cluster allocation */
+	FATFS* fs,			/* Filesystem object */
+	const FFOBJID* obj,	/* Object the cluster has been allocated to */
+	DWORD ncl			/* Allocated cluster */
+)
+{
+	UINT i, j;
+	DWORD end;
+
+
+	for (i = 0; i < FF_CLST_RSV_FILES && fs->rvobj[i] != obj; i++) ;
+	if (i == FF_CLST_RSV_FILES) {	/* Not a writing file? */
+		fs->last_clst = ncl;
+		return;
+	}
+	if (ncl != fs->rvtop[i] || ncl >= fs->rvend[i]) {	/* Out of the window? Open a new window at the cluster */
+		end = ncl + FF_CLST_RESERVE;
+		if (end > fs->n_fatent || end < ncl) end = fs->n_fatent;
+		for (j = 0; j < FF_CLST_RSV_FILES; j++) {	/* Do not overlap the following window */
+			if (j != i && fs->rvobj[j] && fs->rvtop[j] < fs->rvend[j] && fs->rvtop[j] > ncl && fs->rvtop[j] < end) end = fs->rvtop[j];
+		}
+		fs->rvend[i] = end;
+		fs->last_clst = end - 1;	/* Move the allocation cursor past the window */
+	}
+	fs->rvtop[i] = ncl + 1;		/* The allocation cursor is not changed in the window */
+}
+
+
+static void rsv_open (	/* Register a file opened in write mode */
+	FATFS* fs,			/* Filesystem object */
+	const FFOBJID* obj	/* File object */
+)
+{
+	UINT i;
+
+
+	for (i = 0; i < FF_CLST_RSV_FILES && fs->rvobj[i] != obj; i++) ;	/* Find the entry of the object */
+	if (i == FF_CLST_RSV_FILES) {
+		for (i = 0; i < FF_CLST_RSV_FILES && fs->rvobj[i]; i++) ;	/* Find a blank entry */
+		if (i == FF_CLST_RSV_FILES) {		/* Replace an entry if the table is full */
+			i = fs->rvidx;
+			fs->rvidx = (fs->rvidx + 1) % FF_CLST_RSV_FILES;
+		}
+	}
+	fs->rvobj[i] = obj;
+	fs->rvtop[i] = fs->rvend[i] = 0;	/* No window */
+}
+
+
+static void rsv_close (	/* Release the window of a file */
+	FATFS* fs,			/* Filesystem object */
+	const FFOBJID* obj	/* File object */
+)
+{
+	UINT i;
+
+
+	for (i = 0; i < FF_CLST_RSV_FILES; i++) {
+		if (fs->rvobj[i] == obj) {
+			if (fs->rvtop[i] < fs->rvend[i] && fs->last_clst == fs->rvend[i] - 1) {	/* Is the window at the allocation cursor? */
+				fs->last_clst = fs->rvtop[i] - 1;	/* Return the unused clusters to the next allocation */
+			}
+			fs->rvobj[i] = 0;
+		}
+	}
+}
+
+#endif /* FF_CLST_RESERVE && !FF_FS_READONLY */
+
+
+
+
 /*-----------------------------------------------------------------------*/
 /* FAT handling - Stretch a chain or Create a new chain                  */
 /*-----------------------------------------------------------------------*/
@@ -1531,6 +2266,9 @@ static DWORD create_chain (	/* 0:No free cluster, 1:Internal error, 0xFFFFFFFF:D
 	DWORD cs, ncl, scl;
 	FRESULT res;
 	FATFS *fs = obj->fs;
+#if FF_FREE_MAP
+	DWORD nused;
+#endif
 
 
 	if (clst == 0) {	/* Create a new chain */
@@ -1549,6 +2287,12 @@ static DWORD create_chain (	/* 0:No free cluster, 1:Internal error, 0xFFFFFFFF:D
 #if FF_FS_EXFAT
 	if (fs->fs_type == FS_EXFAT) {	/* On the exFAT volume */
 		ncl = find_bitmap(fs, scl, 1);				/* Find a free cluster */
+#if FF_CLST_RESERVE
+		if (clst != 0 && ncl >= 2 && ncl != 0xFFFFFFFF && (ncl != scl + 1 || !rsv_avail(fs, obj, ncl))) {	/* Cannot be contiguous or reserved by another file? */
+			cs = fs->last_clst;						/* Find another fragment at the allocation cursor */
+			if (cs >= 2 && cs < fs->n_fatent) ncl = find_bitmap(fs, cs, 1);
+		}
+#endif
 		if (ncl == 0 || ncl == 0xFFFFFFFF) return ncl;	/* No free cluster or hard error? */
 		res = change_bitmap(fs, ncl, 1, 1);			/* Mark the cluster 'in use' */
 		if (res == FR_INT_ERR) return 1;
@@ -1579,6 +2323,9 @@ static DWORD create_chain (	/* 0:No free cluster, 1:Internal error, 0xFFFFFFFF:D
 			if (ncl >= fs->n_fatent) ncl = 2;
 			cs = get_fat(obj, ncl);				/* Get next cluster status */
 			if (cs == 1 || cs == 0xFFFFFFFF) return cs;	/* Test for error */
+#if FF_CLST_RESERVE
+			if (cs == 0 && !rsv_avail(fs, obj, ncl)) cs = 2;	/* Reserved by another file? (not to be taken) */
+#endif
 			if (cs != 0) {						/* Not free? */
 				cs = fs->last_clst;				/* Start at suggested cluster if it is valid */
 				if (cs >= 2 && cs < fs->n_fatent) scl = cs;
@@ -1587,15 +2334,33 @@ static DWORD create_chain (	/* 0:No free cluster, 1:Internal error, 0xFFFFFFFF:D
 		}
 		if (ncl == 0) {	/* The new cluster cannot be contiguous and find another fragment */
 			ncl = scl;	/* Start cluster */
+#if FF_FREE_MAP
+			nused = 0;
+#endif
 			for (;;) {
 				ncl++;							/* Next cluster */
 				if (ncl >= fs->n_fatent) {		/* Check wrap-around */
 					ncl = 2;
 					if (ncl > scl) return 0;	/* No free cluster found? */
+#if FF_FREE_MAP
+					nused = 0;
+#endif
+				}
+#if FF_FREE_MAP
+				cs = find_fmap(fs, ncl);		/* Skip the cluster groups with no free cluster */
+				if (cs != ncl) {
+					if (ncl <= scl && scl < cs) return 0;	/* No free cluster found? */
+					ncl = cs - 1;
+					nused = 0;
+					continue;
 				}
+#endif
 				cs = get_fat(obj, ncl);			/* Get the cluster status */
 				if (cs == 0) break;				/* Found a free cluster? */
 				if (cs == 1 || cs == 0xFFFFFFFF) return cs;	/* Test for error */
+#if FF_FREE_MAP
+				scan_fmap(fs, ncl, 1, 0, &nused);	/* Clear the group if no free cluster is in it */
+#endif
 				if (ncl == scl) return 0;		/* No free cluster found? */
 			}
 		}
@@ -1606,7 +2371,11 @@ static DWORD create_chain (	/* 0:No free cluster, 1:Internal error, 0xFFFFFFFF:D
 	}
 
 	if (res == FR_OK) {			/* Update FSINFO if function succeeded. */
+#if FF_CLST_RESERVE
+		rsv_alloc(fs, obj, ncl);	/* Update the reservation window and the allocation cursor */
+#else
 		fs->last_clst = ncl;
+#endif
 		if (fs->free_clst <= fs->n_fatent - 2) fs->free_clst--;
 		fs->fsi_flag |= 1;
 	} else {
@@ -1652,49 +2421,429 @@ static DWORD clmt_clust (	/* <2:Error, >=2:Cluster number */
 
 
 
+#if FF_FASTSEEK_AUTO
 /*-----------------------------------------------------------------------*/
-/* Directory handling - Fill a cluster with zeros                        */
+/* FAT handling - Automatic cluster link map                             */
 /*-----------------------------------------------------------------------*/
+/* The map records first xcnt clusters of the chain in fragments. It is
+/  extended only by following the chain on the FAT, so that it is kept
+/  valid while the file grows and is trimmed when the file is truncated. */
 
-#if !FF_FS_READONLY
-static FRESULT dir_clear (	/* Returns FR_OK or FR_DISK_ERR */
-	FATFS *fs,		/* Filesystem object */
-	DWORD clst		/* Directory table to clear */
+#if FF_FS_MINIMIZE <= 2
+static FRESULT extend_map (	/* FR_OK(0):succeeded, !=0:error */
+	FIL* fp,		/* Pointer to the file object */
+	DWORD cl		/* Cluster order to be recorded up to */
 )
 {
-	LBA_t sect;
-	UINT n, szb;
-	BYTE *ibuf;
+	DWORD clst, ncl;
+	FATFS *fs = fp->obj.fs;
 
 
-	if (sync_window(fs) != FR_OK) return FR_DISK_ERR;	/* Flush disk access window */
-	sect = clst2sect(fs, clst);		/* Top of the cluster */
-	fs->winsect = sect;				/* Set window to top of the cluster */
-	memset(fs->win, 0, sizeof fs->win);	/* Clear window buffer */
-#if FF_USE_LFN == 3		/* Quick table clear by using multi-secter write */
-	/* Allocate a temporary buffer */
-	for (szb = ((DWORD)fs->csize * SS(fs) >= MAX_MALLOC) ? MAX_MALLOC : fs->csize * SS(fs), ibuf = 0; szb > SS(fs) && (ibuf = ff_memalloc(szb)) == 0; szb /= 2) ;
-	if (szb > SS(fs)) {		/* Buffer allocated? */
-		memset(ibuf, 0, szb);
-		szb /= SS(fs);		/* Bytes -> Sectors */
-		for (n = 0; n < fs->csize && disk_write(fs->pdrv, ibuf, sect + n, szb) == RES_OK; n += szb) ;	/* Fill the cluster with 0 */
-		ff_memfree(ibuf);
-	} else
-#endif
-	{
-		ibuf = fs->win; szb = 1;	/* Use window buffer (many single-sector writes may take a time) */
-		for (n = 0; n < fs->csize && disk_write(fs->pdrv, ibuf, sect + n, szb) == RES_OK; n += szb) ;	/* Fill the cluster with 0 */
+	if (fp->xcnt == 0) {	/* Blank map? */
+		if (fp->obj.sclust == 0) return FR_OK;
+		fp->xofs[0] = 0; fp->xclst[0] = fp->obj.sclust;
+		fp->xfrag = 1; fp->xcnt = 1;
 	}
-	return (n == fs->csize) ? FR_OK : FR_DISK_ERR;
+	clst = fp->xclst[fp->xfrag - 1] + (fp->xcnt - 1 - fp->xofs[fp->xfrag - 1]);	/* Last cluster in the map */
+	while (fp->xcnt <= cl && !fp->xfull) {
+		ncl = get_fat(&fp->obj, clst);	/* Follow the cluster chain */
+		if (ncl == 0xFFFFFFFF) return FR_DISK_ERR;
+		if (ncl < 2) return FR_INT_ERR;
+		if (ncl >= fs->n_fatent) break;	/* End of chain? */
+		if (ncl != clst + 1) {			/* New fragment? */
+			if (fp->xfrag == FF_FASTSEEK_AUTO) {	/* Map is full? */
+				fp->xfull = 1; break;
+			}
+			fp->xofs[fp->xfrag] = fp->xcnt; fp->xclst[fp->xfrag] = ncl;
+			fp->xfrag++;
+		}
+		fp->xcnt++;
+		clst = ncl;
+	}
+	return FR_OK;
 }
-#endif	/* !FF_FS_READONLY */
+#endif
+
+
+static DWORD map_clust (	/* Cluster number */
+	FIL* fp,		/* Pointer to the file object */
+	DWORD cl		/* Cluster order from top of the file (must be < xcnt) */
+)
+{
+	UINT lo, hi, mid;
+
+
+	lo = 0; hi = fp->xfrag - 1;
+	while (lo < hi) {	/* Find the last fragment which starts at or before cl */
+		mid = (lo + hi + 1) / 2;
+		if (fp->xofs[mid] <= cl) {
+			lo = mid;
+		} else {
+			hi = mid - 1;
+		}
+	}
+	return fp->xclst[lo] + (cl - fp->xofs[lo]);
+}
+
+#endif	/* FF_FASTSEEK_AUTO */
+
+
+
+
+#if FF_READAHEAD
+/*-----------------------------------------------------------------------*/
+/* File data - Prefetch the following sectors on sequential read         */
+/*-----------------------------------------------------------------------*/
+
+static FRESULT read_ahead (	/* Returns FR_OK or FR_DISK_ERR */
+	FIL* fp,		/* Pointer to the file object (fptr is on the sector boundary) */
+	LBA_t sect,		/* Data sector to be read next */
+	UINT cnt		/* Number of sectors to be read next */
+)
+{
+	DWORD clst, ncl;
+	UINT n;
+	FATFS *fs = fp->obj.fs;
+
+
+	n = (sect == fp->ranext && sect - fs->rasect >= fs->racnt);	/* Sequential access of this file and not prefetched yet? */
+	fp->ranext = sect + cnt;
+	if (!n) return FR_OK;
+	if (fs->racnt != 0 && sect != fs->rasect + fs->racnt && fs->rahit) {	/* Is the buffer still used by another stream? */
+		fs->rahit = 0;	/* Hold off the refill (the buffer is taken over if not hit until the next one) */
+		return FR_OK;
+	}
+
+	n = fs->csize - (UINT)(fp->fptr / SS(fs) & (fs->csize - 1));	/* Number of sectors to the end of current cluster */
+	for (clst = fp->clust; n < FF_READAHEAD; clst = ncl, n += fs->csize) {	/* Stretch it over the following contiguous clusters */
+#if FF_USE_FASTSEEK
+		if (fp->cltbl) {
+			ncl = clmt_clust(fp, fp->fptr + (FSIZE_t)n * SS(fs));	/* Get cluster# from the CLMT */
+		} else
+#endif
+		{
+			ncl = get_fat(&fp->obj, clst);	/* Follow cluster chain on the FAT */
+		}
+		if (ncl != clst + 1 || ncl >= fs->n_fatent) break;	/* Not contiguous? */
+	}
+	if (n > FF_READAHEAD) n = FF_READAHEAD;
+	if ((FSIZE_t)n * SS(fs) > fp->obj.objsize - fp->fptr) {	/* Clip it at end of the file */
+		n = (UINT)((fp->obj.objsize - fp->fptr + SS(fs) - 1) / SS(fs));
+	}
+	if (n > cnt) {	/* Fill the read-ahead buffer if more sectors than requested to be read */
+		fs->racnt = 0;
+		if (disk_read(fs->pdrv, fs->rabuf, sect, n) != RES_OK) return FR_DISK_ERR;
+		fs->rasect = sect; fs->racnt = n; fs->rahit = 1;
+	}
+	return FR_OK;
+}
+#endif	/* FF_READAHEAD */
+
+
+
+
+#if !FF_FS_TINY
+/*-----------------------------------------------------------------------*/
+/* File data - Flush/Fill the file data window                           */
+/*-----------------------------------------------------------------------*/
+/* The file data window, fp->buf[], holds fp->bcnt sectors at consecutive LBAs */
+/* from fp->sect and sequential writes are collected into it up to fp->bmax sectors. */
+
+#if !FF_FS_READONLY
+static FRESULT flush_buf (	/* Returns FR_OK or FR_DISK_ERR */
+	FIL* fp			/* Pointer to the file object */
+)
+{
+	FATFS *fs = fp->obj.fs;
+
+
+	if (fp->flag & FA_DIRTY) {	/* Write-back the sectors in the window in a multi-sector write */
+		if (disk_write(fs->pdrv, fp->buf, fp->sect, fp->bcnt) != RES_OK) return FR_DISK_ERR;
+#if FF_READAHEAD
+		inval_cache(fs, fp->sect, fp->bcnt);	/* Discard stale read-ahead data */
+#endif
+		fp->flag &= (BYTE)~FA_DIRTY;
+	}
+	return FR_OK;
+}
+#endif
+
+
+static FRESULT fill_buf (	/* Returns FR_OK or FR_DISK_ERR */
+	FIL* fp,		/* Pointer to the file object (clust and fptr point the sector) */
+	LBA_t sect,		/* Data sector to be the current sector of the window */
+	int wr			/* 0:Read access, 1:Write access */
+)
+{
+	FATFS *fs = fp->obj.fs;
+
+
+	if (sect - fp->sect < fp->bcnt) {	/* Is the sector in the window? */
+		fp->bidx = (UINT)(sect - fp->sect);
+		return FR_OK;
+	}
+	if (!wr || !(fp->flag & FA_DIRTY) || sect != fp->sect + fp->bcnt || fp->bcnt >= fp->bmax) {	/* Cannot be collected next to the dirty sectors? */
+#if !FF_FS_READONLY
+		if (flush_buf(fp) != FR_OK) return FR_DISK_ERR;	/* Write-back the window */
+#endif
+		fp->sect = sect; fp->bcnt = 0;	/* Restart the window at the sector */
+	}
+	fp->bidx = fp->bcnt;
+	if (!wr || fp->fptr < fp->obj.objsize) {	/* Load the sector if it has data (not on the growing edge) */
+#if FF_READAHEAD
+		if (!wr && read_ahead(fp, sect, 1) != FR_OK) return FR_DISK_ERR;	/* Prefetch the following sectors on sequential read */
+#endif
+		if (read_sect(fs, fp->buf + fp->bidx * SS(fs), sect) != RES_OK) return FR_DISK_ERR;
+	}
+	fp->bcnt++;
+	return FR_OK;
+}
+#endif	/* !FF_FS_TINY */
+
+
+
+
+/*-----------------------------------------------------------------------*/
+/* File data - Keep cached sectors coherent with the direct transfer     */
+/*-----------------------------------------------------------------------*/
+
+#if !FF_FS_READONLY && FF_FS_MINIMIZE <= 2
+static void merge_dirty (
+	FIL* fp,		/* Pointer to the file object */
+	LBA_t sect,		/* Top sector read directly */
+	BYTE* buff,		/* Read data */
+	UINT cc			/* Number of sectors */
+)
+{
+#if FF_FS_TINY
+	FATFS *fs = fp->obj.fs;
+#endif
+#if !FF_FS_TINY || FF_WIN_CACHE
+	UINT i;
+#endif
+
+
+#if FF_FS_TINY		/* Replace one of the read sectors with cached data if it contains a dirty sector */
+	if (fs->wflag && fs->winsect - sect < cc) {
+		memcpy(buff + ((fs->winsect - sect) * SS(fs)), fs->win, SS(fs));
+	}
+#if FF_WIN_CACHE
+	for (i = 0; i < FF_WIN_CACHE; i++) {	/* Dirty sectors in the window cache as well */
+		if (fs->cflag[i] && fs->csect[i] - sect < cc) {
+			memcpy(buff + ((fs->csect[i] - sect) * SS(fs)), fs->cbuf[i], SS(fs));
+		}
+	}
+#endif
+#else
+	if (fp->flag & FA_DIRTY) {
+		for (i = 0; i < fp->bcnt; i++) {	/* Dirty sectors in the file data window */
+			if (fp->sect + i - sect < cc) {
+				memcpy(buff + ((fp->sect + i - sect) * SS(fp->obj.fs)), fp->buf + i * SS(fp->obj.fs), SS(fp->obj.fs));
+			}
+		}
+	}
+#endif
+}
+
+
+static void put_direct (
+	FIL* fp,			/* Pointer to the file object */
+	LBA_t sect,			/* Top sector written directly */
+	const BYTE* buff,	/* Written data */
+	UINT cc				/* Number of sectors */
+)
+{
+#if FF_FS_TINY
+	FATFS *fs = fp->obj.fs;
+#else
+	UINT i;
+#endif
+
+
+#if FF_WIN_CACHE || FF_READAHEAD
+	inval_cache(fp->obj.fs, sect, cc);	/* Discard cached copies overwritten by the direct write */
+#endif
+#if FF_FS_TINY
+	if (fs->winsect - sect < cc) {	/* Refill sector cache if it gets invalidated by the direct write */
+		memcpy(fs->win, buff + ((fs->winsect - sect) * SS(fs)), SS(fs));
+		fs->wflag = 0;
+	}
+#else
+	for (i = 0; i < fp->bcnt; i++) {	/* Refill the window if it gets invalidated by the direct write */
+		if (fp->sect + i - sect < cc) {
+			memcpy(fp->buf + i * SS(fp->obj.fs), buff + ((fp->sect + i - sect) * SS(fp->obj.fs)), SS(fp->obj.fs));
+		}
+	}
+#endif
+}
+#endif
+
+
+
+
+#if FF_USE_ASYNC
+/*-----------------------------------------------------------------------*/
+/* File data - Get contiguous sectors for asynchronous transfer          */
+/*-----------------------------------------------------------------------*/
+/* The cluster chain is followed (and stretched on write) here in blocking mode */
+/* and only the data transfer of the sectors is left to the disk I/O layer. */
+
+static FRESULT async_run (	/* FR_OK(0):succeeded, !=0:error */
+	FIL* fp,		/* Pointer to the file object */
+	UINT btx,		/* Number of bytes to be transferred */
+	int wr,			/* 0:Read access, 1:Write access */
+	LBA_t* sect,	/* Pointer to the variable to return the top sector of the run */
+	UINT* cnt		/* Pointer to the variable to return number of sectors (0:no whole sector to transfer) */
+)
+{
+	FATFS *fs = fp->obj.fs;
+	DWORD clst;
+	UINT csect, cc, nc;
+
+
+	*cnt = 0;
+	nc = btx / SS(fs);						/* Number of whole sectors requested */
+	if (fp->fptr % SS(fs) != 0 || nc == 0) return FR_OK;	/* Not on the sector boundary or less than a sector? */
+	csect = (UINT)(fp->fptr / SS(fs) & (fs->csize - 1));	/* Sector offset in the cluster */
+	if (csect == 0) {						/* On the cluster boundary? */
+		if (fp->fptr == 0) {				/* On the top of the file? */
+			clst = fp->obj.sclust;			/* Follow cluster chain from the origin */
+#if !FF_FS_READONLY
+			if (wr && clst == 0) clst = create_chain(&fp->obj, 0);	/* Create a new cluster chain if no cluster is allocated */
+#endif
+		} else {							/* Middle or end of the file */
+#if FF_USE_FASTSEEK
+			if (fp->cltbl) {
+				clst = clmt_clust(fp, fp->fptr);	/* Get cluster# from the CLMT */
+			} else
+#endif
+#if FF_FASTSEEK_AUTO
+			if (!wr && fp->fptr / SS(fs) / fs->csize < fp->xcnt) {
+				clst = map_clust(fp, (DWORD)(fp->fptr / SS(fs) / fs->csize));	/* Get cluster# from the link map */
+			} else
+#endif
+#if !FF_FS_READONLY
+			if (wr) {
+				clst = create_chain(&fp->obj, fp->clust);	/* Follow or stretch cluster chain on the FAT */
+			} else
+#endif
+			{
+				clst = get_fat(&fp->obj, fp->clust);	/* Follow cluster chain on the FAT */
+			}
+		}
+		if (wr && clst == 0) return FR_OK;	/* Could not allocate a new cluster (disk full), left it to f_write() */
+		if (clst < 2) return FR_INT_ERR;
+		if (clst == 0xFFFFFFFF) return FR_DISK_ERR;
+		fp->clust = clst;					/* Update current cluster */
+		if (fp->obj.sclust == 0) fp->obj.sclust = clst;	/* Set start cluster if the first write */
+	}
+	*sect = clst2sect(fs, fp->clust);		/* Get current sector */
+	if (*sect == 0) return FR_INT_ERR;
+	*sect += csect;
+	cc = nc;
+	if (csect + cc > fs->csize) {			/* Clip at cluster boundary */
+		cc = fs->csize - csect;
+		while (cc < nc) {					/* Extend it over the following clusters while they are contiguous */
+#if FF_FS_EXFAT && !FF_FS_READONLY
+			if (wr && fs->fs_type == FS_EXFAT && fp->fptr + (FSIZE_t)cc * SS(fs) >= fp->obj.objsize) break;	/* Do not stretch exFAT chain here (the growing edge cannot be followed again) */
+#endif
+#if FF_USE_FASTSEEK
+			if (fp->cltbl) {
+				clst = clmt_clust(fp, fp->fptr + (FSIZE_t)cc * SS(fs));	/* Get cluster# from the CLMT */
+			} else
+#endif
+			{
+				clst = get_fat(&fp->obj, fp->clust);	/* Follow cluster chain on the FAT */
+#if !FF_FS_READONLY
+				if (wr && clst >= fs->n_fatent && clst != 0xFFFFFFFF) {	/* End of the chain? */
+					clst = fp->clust + 1;	/* Stretch it only with a contiguous free cluster (a cluster not used by this request must not be linked) */
+					if (clst >= fs->n_fatent || get_fat(&fp->obj, clst) != 0) break;
+#if FF_CLST_RESERVE
+					if (!rsv_avail(fs, &fp->obj, clst)) break;
+#endif
+					clst = create_chain(&fp->obj, fp->clust);
+				}
+#endif
+			}
+			if (clst != fp->clust + 1 || clst >= fs->n_fatent) break;	/* Not contiguous? (it is followed again at next cluster boundary) */
+			fp->clust = clst;
+			cc += fs->csize;
+		}
+		if (cc > nc) cc = nc;
+	}
+	*cnt = cc;
+	return FR_OK;
+}
+
+
+static void async_done (
+	void* ctx,		/* Pointer to the request (FF_AREQ) */
+	DRESULT dres	/* Result of the disk transfer */
+)
+{
+	FF_AREQ *req = (FF_AREQ*)ctx;
+
+
+	req->res = FR_OK;
+	if (dres != RES_OK) {					/* Abort the file on a hard error */
+		req->fp->err = (BYTE)FR_DISK_ERR;
+		req->res = FR_DISK_ERR;
+	}
+	req->fp->obj.fs->abusy = 0;				/* The volume is accessible again */
+	req->done = 1;
+	if (req->func) req->func(req->arg, req->res);	/* Notify the completion to the application */
+}
+#endif	/* FF_USE_ASYNC */
+
+
+
+
+/*-----------------------------------------------------------------------*/
+/* Directory handling - Fill a cluster with zeros                        */
+/*-----------------------------------------------------------------------*/
+
+#if !FF_FS_READONLY
+static FRESULT dir_clear (	/* Returns FR_OK or FR_DISK_ERR */
+	FATFS *fs,		/* Filesystem object */
+	DWORD clst		/* Directory table to clear */
+)
+{
+	LBA_t sect;
+	UINT n, szb;
+	BYTE *ibuf;
+
+
+	if (sync_window(fs) != FR_OK) return FR_DISK_ERR;	/* Flush disk access window */
+	sect = clst2sect(fs, clst);		/* Top of the cluster */
+#if FF_WIN_CACHE || FF_READAHEAD
+	inval_cache(fs, sect, fs->csize);	/* Discard stale copies of the cluster */
+#endif
+	fs->winsect = sect;				/* Set window to top of the cluster */
+	memset(fs->win, 0, sizeof fs->win);	/* Clear window buffer */
+#if FF_USE_LFN == 3		/* Quick table clear by using multi-secter write */
+	/* Allocate a temporary buffer */
+	for (szb = ((DWORD)fs->csize * SS(fs) >= MAX_MALLOC) ? MAX_MALLOC : fs->csize * SS(fs), ibuf = 0; szb > SS(fs) && (ibuf = ff_memalloc(szb)) == 0; szb /= 2) ;
+	if (szb > SS(fs)) {		/* Buffer allocated? */
+		memset(ibuf, 0, szb);
+		szb /= SS(fs);		/* Bytes -> Sectors */
+		for (n = 0; n < fs->csize && disk_write(fs->pdrv, ibuf, sect + n, szb) == RES_OK; n += szb) ;	/* Fill the cluster with 0 */
+		ff_memfree(ibuf);
+	} else
+#endif
+	{
+		ibuf = fs->win; szb = 1;	/* Use window buffer (many single-sector writes may take a time) */
+		for (n = 0; n < fs->csize && disk_write(fs->pdrv, ibuf, sect + n, szb) == RES_OK; n += szb) ;	/* Fill the cluster with 0 */
+	}
+	return (n == fs->csize) ? FR_OK : FR_DISK_ERR;
+}
+#endif	/* !FF_FS_READONLY */
 
 
 
 
 /*-----------------------------------------------------------------------*/
-/* Directory handling - Set directory index                              */
-/*-----------------------------------------------------------------------*/
+/* Directory handling - Set directory index                              */
+/*-----------------------------------------------------------------------*/
 
 static FRESULT dir_sdi (	/* FR_OK(0):succeeded, !=0:error */
 	DIR* dp,		/* Pointer to directory object */
@@ -1813,9 +2962,18 @@ static FRESULT dir_alloc (	/* FR_OK(0):succeeded, !=0:error */
 	FRESULT res;
 	UINT n;
 	FATFS *fs = dp->obj.fs;
+#if FF_DIR_HINT
+	UINT hi;
+	DWORD top = 0xFFFFFFFF;
+
+
+	for (hi = 0; hi < FF_DIR_HINT && fs->dhclst[hi] != dp->obj.sclust; hi++) ;	/* Find the hint of the directory */
+	res = dir_sdi(dp, (hi < FF_DIR_HINT) ? fs->dhofs[hi] : 0);	/* No free entry is in front of the hint */
+#else
 
 
 	res = dir_sdi(dp, 0);
+#endif
 	if (res == FR_OK) {
 		n = 0;
 		do {
@@ -1825,6 +2983,9 @@ static FRESULT dir_alloc (	/* FR_OK(0):succeeded, !=0:error */
 			if ((fs->fs_type == FS_EXFAT) ? (int)((dp->dir[XDIR_Type] & 0x80) == 0) : (int)(dp->dir[DIR_Name] == DDEM || dp->dir[DIR_Name] == 0)) {	/* Is the entry free? */
 #else
 			if (dp->dir[DIR_Name] == DDEM || dp->dir[DIR_Name] == 0) {	/* Is the entry free? */
+#endif
+#if FF_DIR_HINT
+				if (top == 0xFFFFFFFF) top = dp->dptr;	/* First free entry */
 #endif
 				if (++n == n_ent) break;	/* Is a block of contiguous free entries found? */
 			} else {
@@ -1834,10 +2995,37 @@ static FRESULT dir_alloc (	/* FR_OK(0):succeeded, !=0:error */
 		} while (res == FR_OK);
 	}
 
+#if FF_DIR_HINT
+	if (res == FR_OK) {		/* Update the hint of the directory */
+		if (hi == FF_DIR_HINT) {	/* Register the directory in place of the oldest one */
+			hi = fs->dhnext;
+			fs->dhnext = (BYTE)((hi + 1) % FF_DIR_HINT);
+			fs->dhclst[hi] = dp->obj.sclust;
+		}
+		fs->dhofs[hi] = (top == dp->dptr - (n_ent - 1) * SZDIRE) ? dp->dptr : top;	/* Last entry allocated or first free entry */
+	}
+#endif
 	if (res == FR_NO_FILE) res = FR_DENIED;	/* No directory entry to allocate */
 	return res;
 }
 
+
+#if FF_DIR_HINT && (FF_FS_MINIMIZE == 0 || FF_USE_LABEL)
+static void put_dhint (
+	FATFS* fs,		/* Filesystem object */
+	DWORD dclst,	/* Start cluster of the directory */
+	DWORD ofs		/* Offset of the entry freed */
+)
+{
+	UINT i;
+
+
+	for (i = 0; i < FF_DIR_HINT; i++) {
+		if (fs->dhclst[i] == dclst && fs->dhofs[i] > ofs) fs->dhofs[i] = ofs;	/* Move back the hint to the free entry */
+	}
+}
+#endif
+
 #endif	/* !FF_FS_READONLY */
 
 
@@ -1890,7 +3078,7 @@ static int cmp_lfn (		/* 1:matched, 0:not matched */
 )
 {
 	UINT i, s;
-	WCHAR wc, uc;
+	WCHAR wc, uc, lc;
 
 
 	if (ld_word(dir + LDIR_FstClusLO) != 0) return 0;	/* Check LDIR_FstClusLO */
@@ -1900,8 +3088,16 @@ static int cmp_lfn (		/* 1:matched, 0:not matched */
 	for (wc = 1, s = 0; s < 13; s++) {		/* Process all characters in the entry */
 		uc = ld_word(dir + LfnOfs[s]);		/* Pick an LFN character */
 		if (wc != 0) {
-			if (i >= FF_MAX_LFN + 1 || ff_wtoupper(uc) != ff_wtoupper(lfnbuf[i++])) {	/* Compare it */
-				return 0;					/* Not matched */
+			if (i >= FF_MAX_LFN + 1) return 0;	/* Not matched (too long) */
+			lc = lfnbuf[i++];
+			if (uc != lc) {					/* Compare it in case-insensitive if not identical */
+				if (uc < 0x80 && lc < 0x80) {	/* ASCII? */
+					if (!IsLower(uc) || uc - 0x20 != lc) {
+						if (!IsLower(lc) || lc - 0x20 != uc) return 0;	/* Not matched */
+					}
+				} else {
+					if (ff_wtoupper(uc) != ff_wtoupper(lc)) return 0;	/* Not matched */
+				}
 			}
 			wc = uc;
 		} else {
@@ -2379,37 +3575,425 @@ static FRESULT dir_read (
 
 
 
+#if FF_DIR_INDEX || (FF_SFN_FILTER && FF_USE_LFN && !FF_FS_READONLY)
 /*-----------------------------------------------------------------------*/
-/* Directory handling - Find an object in the directory                  */
+/* Directory handling - Name index and SFN filter of the FAT directory   */
 /*-----------------------------------------------------------------------*/
 
-static FRESULT dir_find (	/* FR_OK(0):succeeded, !=0:error */
-	DIR* dp					/* Pointer to the directory object with the file name */
+static DWORD sfn_hash (	/* Hash value of the SFN */
+	const BYTE* sfn		/* Pointer to the SFN (11 bytes) */
 )
 {
-	FRESULT res;
-	FATFS *fs = dp->obj.fs;
-	BYTE c;
-#if FF_USE_LFN
-	BYTE a, ord, sum;
-#endif
+	DWORD hash = 0x811C9DC5;
+	UINT n = 11;
 
-	res = dir_sdi(dp, 0);			/* Rewind directory object */
-	if (res != FR_OK) return res;
-#if FF_FS_EXFAT
-	if (fs->fs_type == FS_EXFAT) {	/* On the exFAT volume */
-		BYTE nc;
-		UINT di, ni;
-		WORD hash = xname_sum(fs->lfnbuf);		/* Hash value of the name to find */
 
-		while ((res = DIR_READ_FILE(dp)) == FR_OK) {	/* Read an item */
-#if FF_MAX_LFN < 255
-			if (fs->dirbuf[XDIR_NumName] > FF_MAX_LFN) continue;		/* Skip comparison if inaccessible object name */
+	do {
+		hash = (hash ^ *sfn++) * 0x01000193;
+	} while (--n);
+	return hash ^ hash >> 16;
+}
+#endif
+
+
+#if FF_DIR_INDEX
+
+
+#if FF_USE_LFN
+static WORD lfn_hash (	/* Hash value of a character in the LFN */
+	UINT ofs,			/* Position of the character in the LFN */
+	WCHAR wc			/* Character */
+)
+{
+	DWORD h = (ff_wtoupper(wc) | (DWORD)ofs << 16) * 0x9E3779B1;
+
+
+	/* The hash value of an LFN is the sum of the value of every character, so that
+	/  it can be accumulated from the LFN entries in the order on the directory */
+	h ^= h >> 15;
+	h *= 0x85EBCA6B;
+	h ^= h >> 13;
+	return (WORD)(h >> 16);
+}
+#endif
+
+
+static void build_dindex (
+	DIR* dp				/* Pointer to the directory object to be indexed */
+)
+{
+	FATFS *fs = dp->obj.fs;
+	DIR dj;
+	FRESULT res;
+	UINT n = 0;
+	BYTE c;
+#if FF_USE_LFN
+	BYTE a;
+	UINT i, ofs;
+	WCHAR wc;
+	WORD lh = 0;
+	DWORD top = 0xFFFFFFFF;
+#endif
+
+
+	fs->dxstat = 0;
+	fs->dxclst = dp->obj.sclust;
+	dj.obj = dp->obj;
+	res = dir_sdi(&dj, 0);
+	while (res == FR_OK) {
+		res = move_window(fs, dj.sect);
+		if (res != FR_OK) return;
+		c = dj.dir[DIR_Name];
+		if (c == 0) break;	/* Reached to end of table */
+#if FF_USE_LFN
+		a = dj.dir[DIR_Attr] & AM_MASK;
+		if (c == DDEM || ((a & AM_VOL) && a != AM_LFN)) {	/* An entry without valid data */
+			top = 0xFFFFFFFF; lh = 0;
+		} else if (a == AM_LFN) {	/* An LFN entry (the hash value can be valid only for the last LFN sequence) */
+			if (c & LLEF) {
+				top = dj.dptr; lh = 0;
+			}
+			ofs = ((c & 0x3F) - 1) * 13;
+			for (i = 0; i < 13 && (wc = ld_word(dj.dir + LfnOfs[i])) != 0; i++) lh += lfn_hash(ofs + i, wc);
+		} else {					/* An SFN entry */
+			if (n >= FF_DIR_INDEX) { fs->dxstat = 2; return; }	/* Too many objects to be indexed */
+			fs->dxtop[n] = (WORD)(((top != 0xFFFFFFFF) ? top : dj.dptr) / SZDIRE);
+			fs->dxlh[n] = lh;
+			fs->dxsfn[n] = (WORD)(dj.dptr / SZDIRE);
+			fs->dxsh[n++] = (WORD)sfn_hash(dj.dir);
+			top = 0xFFFFFFFF; lh = 0;
+		}
+#else
+		if (c != DDEM && !(dj.dir[DIR_Attr] & AM_VOL)) {
+			if (n >= FF_DIR_INDEX) { fs->dxstat = 2; return; }	/* Too many objects to be indexed */
+			fs->dxsfn[n] = (WORD)(dj.dptr / SZDIRE);
+			fs->dxsh[n++] = (WORD)sfn_hash(dj.dir);
+		}
+#endif
+		res = dir_next(&dj, 0);
+	}
+	if (res == FR_OK || res == FR_NO_FILE) {	/* All objects in the directory have been indexed */
+		fs->dxcnt = n;
+		fs->dxstat = 1;
+	}
+}
+
+
+static FRESULT find_dindex (	/* FR_OK(0):succeeded, !=0:error */
+	DIR* dp					/* Pointer to the directory object with the file name */
+)
+{
+	FRESULT res;
+	FATFS *fs = dp->obj.fs;
+	UINT n;
+	WORD sh;
+#if FF_USE_LFN
+	BYTE c, a, ord, sum;
+	WORD lh = 0;
+
+	for (n = 0; fs->lfnbuf[n]; n++) lh += lfn_hash(n, fs->lfnbuf[n]);	/* Hash value of the LFN to find */
+#endif
+	sh = (WORD)sfn_hash(dp->fn);	/* Hash value of the SFN to find */
+
+	for (n = 0; n < fs->dxcnt; n++) {	/* Check the objects whose hash value matches the name */
+#if FF_USE_LFN
+		if ((dp->fn[NSFLAG] & NS_NOLFN) || fs->dxlh[n] != lh) {
+			if ((dp->fn[NSFLAG] & NS_LOSS) || fs->dxsh[n] != sh) continue;
+		}
+		res = dir_sdi(dp, (DWORD)fs->dxtop[n] * SZDIRE);	/* Compare the object in the same way as dir_find() */
+		ord = sum = 0xFF; dp->blk_ofs = 0xFFFFFFFF;
+		for (;;) {
+			if (res == FR_OK) res = move_window(fs, dp->sect);
+			if (res != FR_OK) return res;
+			c = dp->dir[DIR_Name];
+			dp->obj.attr = a = dp->dir[DIR_Attr] & AM_MASK;
+			if (a != AM_LFN) break;	/* SFN entry of the object */
+			if (!(dp->fn[NSFLAG] & NS_NOLFN)) {
+				if (c & LLEF) {
+					sum = dp->dir[LDIR_Chksum];
+					c &= (BYTE)~LLEF; ord = c;
+					dp->blk_ofs = dp->dptr;
+				}
+				ord = (c == ord && sum == dp->dir[LDIR_Chksum] && cmp_lfn(fs->lfnbuf, dp->dir)) ? ord - 1 : 0xFF;
+			}
+			res = dir_next(dp, 0);
+		}
+		if (ord == 0 && sum == sum_sfn(dp->dir)) return FR_OK;	/* LFN matched? */
+		if (!(dp->fn[NSFLAG] & NS_LOSS) && !memcmp(dp->dir, dp->fn, 11)) return FR_OK;	/* SFN matched? */
+#else
+		if (fs->dxsh[n] != sh) continue;
+		res = dir_sdi(dp, (DWORD)fs->dxsfn[n] * SZDIRE);
+		if (res == FR_OK) res = move_window(fs, dp->sect);
+		if (res != FR_OK) return res;
+		dp->obj.attr = dp->dir[DIR_Attr] & AM_MASK;
+		if (!memcmp(dp->dir, dp->fn, 11)) return FR_OK;	/* SFN matched? */
+#endif
+	}
+	return FR_NO_FILE;
+}
+
+
+#if !FF_FS_READONLY
+static void add_dindex (
+	DIR* dp				/* Pointer to the directory object pointing the SFN entry registered */
+)
+{
+	FATFS *fs = dp->obj.fs;
+	UINT n;
+#if FF_USE_LFN
+	UINT i;
+	WORD lh;
+#endif
+
+
+	if (fs->dxstat != 1 || fs->dxclst != dp->obj.sclust) return;	/* Not the indexed directory? */
+	if (fs->dxcnt >= FF_DIR_INDEX) {	/* No room in the index? */
+		fs->dxstat = 2;
+		return;
+	}
+	n = fs->dxcnt++;
+#if FF_USE_LFN
+	lh = 0; i = 0;
+	if (dp->fn[NSFLAG] & NS_LFN) {	/* Has the object LFN entries? */
+		for ( ; fs->lfnbuf[i]; i++) lh += lfn_hash(i, fs->lfnbuf[i]);
+		i = (i + 12) / 13;
+	}
+	fs->dxtop[n] = (WORD)(dp->dptr / SZDIRE - i);
+	fs->dxlh[n] = lh;
+#endif
+	fs->dxsfn[n] = (WORD)(dp->dptr / SZDIRE);
+	fs->dxsh[n] = (WORD)sfn_hash(dp->fn);
+}
+#endif	/* !FF_FS_READONLY */
+
+
+#if !FF_FS_READONLY && FF_FS_MINIMIZE == 0
+static void del_dindex (
+	DIR* dp				/* Pointer to the directory object pointing the SFN entry to be removed */
+)
+{
+	FATFS *fs = dp->obj.fs;
+	UINT n;
+
+
+	if (fs->dxstat != 1 || fs->dxclst != dp->obj.sclust) return;	/* Not the indexed directory? */
+	for (n = 0; n < fs->dxcnt && fs->dxsfn[n] != (WORD)(dp->dptr / SZDIRE); n++) ;
+	if (n == fs->dxcnt) {	/* Not in the index (the index is broken) */
+		fs->dxstat = 0;
+		return;
+	}
+	fs->dxcnt--;			/* Fill the hole with the last item */
+#if FF_USE_LFN
+	fs->dxtop[n] = fs->dxtop[fs->dxcnt];
+	fs->dxlh[n] = fs->dxlh[fs->dxcnt];
+#endif
+	fs->dxsfn[n] = fs->dxsfn[fs->dxcnt];
+	fs->dxsh[n] = fs->dxsh[fs->dxcnt];
+}
+#endif	/* !FF_FS_READONLY && FF_FS_MINIMIZE == 0 */
+#endif	/* FF_DIR_INDEX */
+
+
+#if FF_SFN_FILTER && FF_USE_LFN && !FF_FS_READONLY
+static int test_sfnf (	/* 1:The SFN may exist in the directory, 0:The SFN does not exist */
+	FATFS* fs,			/* Filesystem object */
+	const BYTE* sfn,	/* Pointer to the SFN */
+	int set				/* 1:Add the SFN to the filter */
+)
+{
+	DWORD hash = sfn_hash(sfn);
+	UINT i1, i2;
+
+
+	i1 = hash % (FF_SFN_FILTER * 8);	/* Two bits are tested per SFN */
+	i2 = (hash * 0x9E3779B1 >> 8) % (FF_SFN_FILTER * 8);
+	if (set) {
+		fs->nfbits[i1 / 8] |= 1 << (i1 % 8);
+		fs->nfbits[i2 / 8] |= 1 << (i2 % 8);
+	}
+	return (fs->nfbits[i1 / 8] & (1 << (i1 % 8))) && (fs->nfbits[i2 / 8] & (1 << (i2 % 8)));
+}
+
+
+static FRESULT load_sfnf (	/* FR_OK(0):succeeded, !=0:error */
+	DIR* dp					/* Pointer to the directory object */
+)
+{
+	FATFS *fs = dp->obj.fs;
+	DIR dj;
+	FRESULT res;
+	BYTE c, a;
+
+
+	if (fs->nfstat && fs->nfclst == dp->obj.sclust) return FR_OK;	/* The filter is for this directory? */
+
+	fs->nfstat = 0;		/* Build the filter with all SFNs in the directory */
+	fs->nfclst = dp->obj.sclust;
+	memset(fs->nfbits, 0, sizeof fs->nfbits);
+	dj.obj = dp->obj;
+	res = dir_sdi(&dj, 0);
+	while (res == FR_OK) {
+		res = move_window(fs, dj.sect);
+		if (res != FR_OK) break;
+		c = dj.dir[DIR_Name];
+		if (c == 0) break;	/* Reached to end of table */
+		a = dj.dir[DIR_Attr] & AM_MASK;
+		if (c != DDEM && !(a & AM_VOL)) test_sfnf(fs, dj.dir, 1);	/* Add the SFN entry */
+		res = dir_next(&dj, 0);
+	}
+	if (res == FR_NO_FILE) res = FR_OK;
+	if (res == FR_OK) fs->nfstat = 1;
+	return res;
+}
+#endif
+
+
+
+
+#if FF_PATH_CACHE
+/*-----------------------------------------------------------------------*/
+/* Directory handling - Path cache                                       */
+/*-----------------------------------------------------------------------*/
+
+#if FF_USE_LFN
+static UINT pcache_name (	/* Returns length of the name (16:too long to be cached) */
+	const WCHAR* lfn,		/* Pointer to the segment name */
+	WCHAR* key				/* Buffer to store the up-cased name (16 items) */
+)
+{
+	UINT n;
+
+
+	for (n = 0; n < 16; n++) {
+		key[n] = (WCHAR)ff_wtoupper(lfn[n]);
+		if (key[n] == 0) break;
+	}
+	return n;
+}
+#endif
+
+
+static UINT find_pcache (	/* Returns index of the entry (FF_PATH_CACHE:not in the cache) */
+	DIR* dp					/* Pointer to the directory object with the segment name */
+)
+{
+	FATFS *fs = dp->obj.fs;
+	UINT i;
+#if FF_USE_LFN
+	UINT n;
+	WCHAR key[16];
+#endif
+
+
+	if ((FF_FS_EXFAT && fs->fs_type == FS_EXFAT) || (dp->fn[NSFLAG] & NS_DOT)) return FF_PATH_CACHE;
+#if FF_USE_LFN
+	n = pcache_name(fs->lfnbuf, key);
+	if (n >= 16) return FF_PATH_CACHE;
+#endif
+	for (i = 0; i < FF_PATH_CACHE; i++) {
+		if (fs->pcname[i][0] == 0 || fs->pcdir[i] != dp->obj.sclust) continue;
+#if FF_USE_LFN
+		if (!memcmp(fs->pcname[i], key, (n + 1) * sizeof (WCHAR))) break;
+#else
+		if (!memcmp(fs->pcname[i], dp->fn, 11)) break;
+#endif
+	}
+	if (i < FF_PATH_CACHE) fs->pcage[i] = ++fs->pctick;
+	return i;
+}
+
+
+static void add_pcache (
+	DIR* dp,			/* Pointer to the directory object with the segment name (pointing the object found) */
+	DWORD ofs			/* Offset of the SFN entry of the object (0xFFFFFFFF:the object does not exist) */
+)
+{
+	FATFS *fs = dp->obj.fs;
+	UINT i, n;
+#if FF_USE_LFN
+	WCHAR key[16];
+#endif
+
+
+	if ((FF_FS_EXFAT && fs->fs_type == FS_EXFAT) || (dp->fn[NSFLAG] & NS_DOT)) return;
+#if FF_USE_LFN
+	if (pcache_name(fs->lfnbuf, key) >= 16) return;	/* Too long name to be cached? */
+#endif
+	for (i = n = 0; i < FF_PATH_CACHE; i++) {	/* Find a blank or the least recently used entry */
+		if (fs->pcname[i][0] == 0) { n = i; break; }
+		if (fs->pcage[i] < fs->pcage[n]) n = i;
+	}
+	fs->pcage[n] = ++fs->pctick;
+	fs->pcdir[n] = dp->obj.sclust;
+	fs->pcofs[n] = ofs;
+	if (ofs != 0xFFFFFFFF) {	/* Save the location of the object found */
+		fs->pcattr[n] = dp->obj.attr;
+		fs->pcclst[n] = ld_clust(fs, dp->dir);
+#if FF_USE_LFN
+		fs->pcblk[n] = dp->blk_ofs;
+#endif
+	}
+#if FF_USE_LFN
+	memcpy(fs->pcname[n], key, sizeof fs->pcname[n]);
+#else
+	memcpy(fs->pcname[n], dp->fn, 11);
+#endif
+}
+
+
+#if !FF_FS_READONLY
+static void del_pcache (
+	FATFS* fs,			/* Filesystem object */
+	DWORD dclst,		/* Start cluster of the directory */
+	DWORD ofs			/* Offset of the SFN entry of the object to be removed (0xFFFFFFFF:all names not exist) */
+)
+{
+	UINT i;
+
+
+	for (i = 0; i < FF_PATH_CACHE; i++) {
+		if (fs->pcdir[i] == dclst && fs->pcofs[i] == ofs) fs->pcname[i][0] = 0;
+	}
+}
+#endif
+#endif	/* FF_PATH_CACHE */
+
+
+
+
+/*-----------------------------------------------------------------------*/
+/* Directory handling - Find an object in the directory                  */
+/*-----------------------------------------------------------------------*/
+
+static FRESULT dir_find (	/* FR_OK(0):succeeded, !=0:error */
+	DIR* dp					/* Pointer to the directory object with the file name */
+)
+{
+	FRESULT res;
+	FATFS *fs = dp->obj.fs;
+	BYTE c;
+#if FF_USE_LFN
+	BYTE a, ord, sum;
+#endif
+
+	res = dir_sdi(dp, 0);			/* Rewind directory object */
+	if (res != FR_OK) return res;
+#if FF_FS_EXFAT
+	if (fs->fs_type == FS_EXFAT) {	/* On the exFAT volume */
+		BYTE nc;
+		UINT di, ni;
+		WCHAR wc;
+		WORD hash = xname_sum(fs->lfnbuf);		/* Hash value of the name to find */
+
+		while ((res = DIR_READ_FILE(dp)) == FR_OK) {	/* Read an item */
+#if FF_MAX_LFN < 255
+			if (fs->dirbuf[XDIR_NumName] > FF_MAX_LFN) continue;		/* Skip comparison if inaccessible object name */
 #endif
 			if (ld_word(fs->dirbuf + XDIR_NameHash) != hash) continue;	/* Skip comparison if hash mismatched */
 			for (nc = fs->dirbuf[XDIR_NumName], di = SZDIRE * 2, ni = 0; nc; nc--, di += 2, ni++) {	/* Compare the name */
 				if ((di % SZDIRE) == 0) di += 2;
-				if (ff_wtoupper(ld_word(fs->dirbuf + di)) != ff_wtoupper(fs->lfnbuf[ni])) break;
+				wc = ld_word(fs->dirbuf + di);
+				if (wc != fs->lfnbuf[ni] && ff_wtoupper(wc) != ff_wtoupper(fs->lfnbuf[ni])) break;	/* Compare it in case-insensitive if not identical */
 			}
 			if (nc == 0 && !fs->lfnbuf[ni]) break;	/* Name matched? */
 		}
@@ -2417,6 +4001,12 @@ static FRESULT dir_find (	/* FR_OK(0):succeeded, !=0:error */
 	}
 #endif
 	/* On the FAT/FAT32 volume */
+#if FF_DIR_INDEX
+	if (fs->dxstat == 1 && fs->dxclst == dp->obj.sclust) {	/* Search the indexed directory */
+		fs->dxmiss = 0;		/* The index is in use and it is not replaced */
+		return find_dindex(dp);
+	}
+#endif
 #if FF_USE_LFN
 	ord = sum = 0xFF; dp->blk_ofs = 0xFFFFFFFF;	/* Reset LFN sequence */
 #endif
@@ -2453,6 +4043,18 @@ static FRESULT dir_find (	/* FR_OK(0):succeeded, !=0:error */
 		res = dir_next(dp, 0);	/* Next entry */
 	} while (res == FR_OK);
 
+#if FF_DIR_INDEX
+	if ((res == FR_OK || res == FR_NO_FILE) && dp->dptr >= SS(fs) && (fs->dxstat == 0 || fs->dxclst != dp->obj.sclust)) {	/* Has the search taken more than a sector? */
+		if (fs->dxmiss == 0 || fs->dxcand != dp->obj.sclust) {	/* Count the long searches in a directory */
+			fs->dxcand = dp->obj.sclust; fs->dxmiss = 0;
+		}
+		if (++fs->dxmiss >= 2) {	/* Repeated in the directory without another long search or use of the index in between? */
+			fs->dxmiss = 0;
+			build_dindex(dp);	/* Index the directory for subsequent searches */
+			if (res == FR_OK) res = move_window(fs, dp->sect);	/* Reload the entry found */
+		}
+	}
+#endif
 	return res;
 }
 
@@ -2513,10 +4115,23 @@ static FRESULT dir_register (	/* FR_OK:succeeded, FR_DENIED:no free entry or too
 	memcpy(sn, dp->fn, 12);
 	if (sn[NSFLAG] & NS_LOSS) {			/* When LFN is out of 8.3 format, generate a numbered name */
 		dp->fn[NSFLAG] = NS_NOLFN;		/* Find only SFN */
-		for (n = 1; n < 100; n++) {
-			gen_numname(dp->fn, sn, fs->lfnbuf, n);	/* Generate a numbered name */
-			res = dir_find(dp);				/* Check if the name collides with existing SFN */
-			if (res != FR_OK) break;
+#if FF_SFN_FILTER
+		res = load_sfnf(dp);			/* Load the SFN filter of the directory */
+		if (res != FR_OK) return res;
+		for (n = 1; n < 100; n++) {		/* Pick a numbered name without searching the directory */
+			gen_numname(dp->fn, sn, fs->lfnbuf, n);
+			if (!test_sfnf(fs, dp->fn, 0)) break;	/* The name is not in the directory */
+		}
+		if (n < 100) {
+			res = FR_NO_FILE;
+		} else							/* All numbered names may collide */
+#endif
+		{
+			for (n = 1; n < 100; n++) {
+				gen_numname(dp->fn, sn, fs->lfnbuf, n);	/* Generate a numbered name */
+				res = dir_find(dp);				/* Check if the name collides with existing SFN */
+				if (res != FR_OK) break;
+			}
 		}
 		if (n == 100) return FR_DENIED;		/* Abort if too many collisions */
 		if (res != FR_NO_FILE) return res;	/* Abort if the result is other than 'not collided' */
@@ -2555,6 +4170,15 @@ static FRESULT dir_register (	/* FR_OK:succeeded, FR_DENIED:no free entry or too
 			dp->dir[DIR_NTres] = dp->fn[NSFLAG] & (NS_BODY | NS_EXT);	/* Put NT flag */
 #endif
 			fs->wflag = 1;
+#if FF_DIR_INDEX
+			add_dindex(dp);	/* Add the object to the name index */
+#endif
+#if FF_PATH_CACHE
+			del_pcache(fs, dp->obj.sclust, 0xFFFFFFFF);	/* The names not found in the directory may exist now */
+#endif
+#if FF_SFN_FILTER && FF_USE_LFN
+			if (fs->nfstat && fs->nfclst == dp->obj.sclust) test_sfnf(fs, dp->fn, 1);	/* Add the SFN to the filter */
+#endif
 		}
 	}
 
@@ -2579,6 +4203,15 @@ static FRESULT dir_remove (	/* FR_OK:Succeeded, FR_DISK_ERR:A disk error */
 #if FF_USE_LFN		/* LFN configuration */
 	DWORD last = dp->dptr;
 
+#if FF_DIR_INDEX
+	del_dindex(dp);		/* Remove the object from the name index */
+#endif
+#if FF_PATH_CACHE
+	del_pcache(fs, dp->obj.sclust, dp->dptr);	/* Remove the object from the path cache */
+#endif
+#if FF_DIR_HINT
+	put_dhint(fs, dp->obj.sclust, (dp->blk_ofs == 0xFFFFFFFF) ? dp->dptr : dp->blk_ofs);	/* The entry block gets free */
+#endif
 	res = (dp->blk_ofs == 0xFFFFFFFF) ? FR_OK : dir_sdi(dp, dp->blk_ofs);	/* Goto top of the entry block if LFN is exist */
 	if (res == FR_OK) {
 		do {
@@ -2597,6 +4230,15 @@ static FRESULT dir_remove (	/* FR_OK:Succeeded, FR_DISK_ERR:A disk error */
 	}
 #else			/* Non LFN configuration */
 
+#if FF_DIR_INDEX
+	del_dindex(dp);		/* Remove the object from the name index */
+#endif
+#if FF_PATH_CACHE
+	del_pcache(fs, dp->obj.sclust, dp->dptr);	/* Remove the object from the path cache */
+#endif
+#if FF_DIR_HINT
+	put_dhint(fs, dp->obj.sclust, dp->dptr);	/* The entry gets free */
+#endif
 	res = move_window(fs, dp->sect);
 	if (res == FR_OK) {
 		dp->dir[DIR_Name] = DDEM;	/* Mark the entry 'deleted'.*/
@@ -2868,7 +4510,7 @@ static FRESULT create_name (	/* FR_OK: successful, FR_INVALID_NAME: could not cr
 		if (uc >= 0x10000) lfn[di++] = (WCHAR)(uc >> 16);	/* Store high surrogate if needed */
 		wc = (WCHAR)uc;
 		if (wc < ' ' || IsSeparator(wc)) break;	/* Break if end of the path or a separator is found */
-		if (wc < 0x80 && strchr("*:<>|\"\?\x7F", (int)wc)) return FR_INVALID_NAME;	/* Reject illegal characters for LFN */
+		if (wc < 0x80 && (ChrCls[wc] & 1)) return FR_INVALID_NAME;	/* Reject illegal characters for LFN */
 		if (di >= FF_MAX_LFN) return FR_INVALID_NAME;	/* Reject too long name */
 		lfn[di++] = wc;				/* Store the Unicode character */
 	}
@@ -2950,7 +4592,7 @@ static FRESULT create_name (	/* FR_OK: successful, FR_INVALID_NAME: could not cr
 			}
 			dp->fn[i++] = (BYTE)(wc >> 8);	/* Put 1st byte */
 		} else {						/* SBC */
-			if (wc == 0 || strchr("+,;=[]", (int)wc)) {	/* Replace illegal characters for SFN */
+			if (wc == 0 || (wc < 0x80 && (ChrCls[wc] & 2))) {	/* Replace illegal characters for SFN */
 				wc = '_'; cf |= NS_LOSS | NS_LFN;/* Lossy conversion */
 			} else {
 				if (IsUpper(wc)) {		/* ASCII upper case? */
@@ -3058,6 +4700,9 @@ static FRESULT follow_path (	/* FR_OK(0): successful, !=0: error code */
 	FRESULT res;
 	BYTE ns;
 	FATFS *fs = dp->obj.fs;
+#if FF_PATH_CACHE
+	UINT pc;
+#endif
 
 
 #if FF_FS_RPATH != 0
@@ -3094,8 +4739,33 @@ static FRESULT follow_path (	/* FR_OK(0): successful, !=0: error code */
 		for (;;) {
 			res = create_name(dp, &path);	/* Get a segment name of the path */
 			if (res != FR_OK) break;
-			res = dir_find(dp);				/* Find an object with the segment name */
 			ns = dp->fn[NSFLAG];
+#if FF_PATH_CACHE
+			pc = find_pcache(dp);			/* Check if the segment name is in the path cache */
+			if (pc < FF_PATH_CACHE) {
+				if (fs->pcofs[pc] == 0xFFFFFFFF) {	/* The object is known not to exist */
+					res = (ns & NS_LAST) ? FR_NO_FILE : FR_NO_PATH;
+					break;
+				}
+				if (!(ns & NS_LAST)) {		/* Get into the sub-directory without searching the directory */
+					if (!(fs->pcattr[pc] & AM_DIR)) {
+						res = FR_NO_PATH; break;
+					}
+					dp->obj.sclust = fs->pcclst[pc];
+					continue;
+				}
+				res = dir_sdi(dp, fs->pcofs[pc]);	/* Last segment: Load the entry of the object */
+				if (res == FR_OK) res = move_window(fs, dp->sect);
+				if (res == FR_OK) {
+					dp->obj.attr = dp->dir[DIR_Attr] & AM_MASK;
+#if FF_USE_LFN
+					dp->blk_ofs = fs->pcblk[pc];
+#endif
+				}
+				break;
+			}
+#endif
+			res = dir_find(dp);				/* Find an object with the segment name */
 			if (res != FR_OK) {				/* Failed to find the object */
 				if (res == FR_NO_FILE) {	/* Object is not found */
 					if (FF_FS_RPATH && (ns & NS_DOT)) {	/* If dot entry is not exist, stay there */
@@ -3103,11 +4773,17 @@ static FRESULT follow_path (	/* FR_OK(0): successful, !=0: error code */
 						dp->fn[NSFLAG] = NS_NONAME;
 						res = FR_OK;
 					} else {							/* Could not find the object */
+#if FF_PATH_CACHE
+						add_pcache(dp, 0xFFFFFFFF);		/* Cache the name not found */
+#endif
 						if (!(ns & NS_LAST)) res = FR_NO_PATH;	/* Adjust error code if not last segment */
 					}
 				}
 				break;
 			}
+#if FF_PATH_CACHE
+			add_pcache(dp, dp->dptr);		/* Cache the name found */
+#endif
 			if (ns & NS_LAST) break;		/* Last segment matched. Function completed. */
 			/* Get into the sub-directory */
 			if (!(dp->obj.attr & AM_DIR)) {	/* It is not a sub-directory and cannot follow */
@@ -3300,6 +4976,15 @@ static UINT check_fs (	/* 0:FAT/FAT32 VBR, 1:exFAT VBR, 2:Not FAT and valid BS,
 
 
 	fs->wflag = 0; fs->winsect = (LBA_t)0 - 1;		/* Invaidate window */
+#if FF_WIN_CACHE || FF_READAHEAD
+	inval_cache(fs, 0, 0);							/* Invalidate window cache and read-ahead buffer */
+#endif
+#if FF_FAT_CACHE
+	inval_fatcache(fs);								/* Invalidate FAT cache */
+#endif
+#if FF_LAZY_FAT2 && !FF_FS_READONLY
+	fs->n_mirror = 0;								/* Discard pending 2nd FAT updates */
+#endif
 	if (move_window(fs, sect) != FR_OK) return 4;	/* Load the boot sector */
 	sign = ld_word(fs->win + BS_55AA);
 #if FF_FS_EXFAT
@@ -3411,6 +5096,9 @@ static FRESULT mount_volume (	/* FR_OK(0): successful, !=0: an error occurred */
 	if (!lock_volume(fs, 1)) return FR_TIMEOUT;	/* Lock the volume, and system if needed */
 #endif
 	*rfs = fs;							/* Return pointer to the filesystem object */
+#if FF_USE_ASYNC
+	if (fs->abusy) return FR_LOCKED;	/* Reject it while an asynchronous transfer is in progress */
+#endif
 
 	mode &= (BYTE)~FA_READ;				/* Desired access mode, write access or not */
 	if (fs->fs_type != 0) {				/* If the volume has been mounted */
@@ -3451,6 +5139,7 @@ static FRESULT mount_volume (	/* FR_OK(0): successful, !=0: an error occurred */
 	if (fmt == 1) {
 		QWORD maxlba;
 		DWORD so, cv, bcl, i;
+		BYTE *fw;
 
 		for (i = BPB_ZeroedEx; i < BPB_ZeroedEx + 53 && fs->win[i] == 0; i++) ;	/* Check zero filler */
 		if (i < BPB_ZeroedEx + 53) return FR_NO_FILESYSTEM;
@@ -3498,8 +5187,9 @@ static FRESULT mount_volume (	/* FR_OK(0): successful, !=0: an error occurred */
 		if (bcl < 2 || bcl >= fs->n_fatent) return FR_NO_FILESYSTEM;	/* (Wrong cluster#) */
 		fs->bitbase = fs->database + fs->csize * (bcl - 2);	/* Bitmap sector */
 		for (;;) {	/* Check if bitmap is contiguous */
-			if (move_window(fs, fs->fatbase + bcl / (SS(fs) / 4)) != FR_OK) return FR_DISK_ERR;
-			cv = ld_dword(fs->win + bcl % (SS(fs) / 4) * 4);
+			fw = fat_window(fs, fs->fatbase + bcl / (SS(fs) / 4), 0);
+			if (!fw) return FR_DISK_ERR;
+			cv = ld_dword(fw + bcl % (SS(fs) / 4) * 4);
 			if (cv == 0xFFFFFFFF) break;				/* Last link? */
 			if (cv != ++bcl) return FR_NO_FILESYSTEM;	/* Fragmented bitmap? */
 		}
@@ -3585,9 +5275,34 @@ static FRESULT mount_volume (	/* FR_OK(0): successful, !=0: an error occurred */
 			}
 		}
 #endif	/* (FF_FS_NOFSINFO & 3) != 3 */
+#if FF_FREE_MAP
+		init_fmap(fs);	/* Initialize the free space map */
+#endif
 #endif	/* !FF_FS_READONLY */
 	}
 
+#if FF_FREE_EXTENT && FF_USE_EXPAND && !FF_FS_READONLY
+	fs->fxflag = 0;		/* Free extent index is blank */
+	memset(fs->fxncl, 0, sizeof fs->fxncl);
+#endif
+#if FF_CLST_RESERVE && !FF_FS_READONLY
+	memset(fs->rvobj, 0, sizeof fs->rvobj);	/* No reservation window */
+	fs->rvidx = 0;
+#endif
+#if FF_DIR_INDEX
+	fs->dxstat = 0;		/* Directory name index is blank */
+	fs->dxmiss = 0;
+#endif
+#if FF_PATH_CACHE
+	memset(fs->pcname, 0, sizeof fs->pcname);	/* Path cache is blank */
+#endif
+#if FF_SFN_FILTER && FF_USE_LFN && !FF_FS_READONLY
+	fs->nfstat = 0;		/* SFN filter is blank */
+#endif
+#if FF_DIR_HINT && !FF_FS_READONLY
+	fs->dhnext = 0;		/* Free entry hints are blank */
+	memset(fs->dhofs, 0, sizeof fs->dhofs);
+#endif
 	fs->fs_type = (BYTE)fmt;/* FAT sub-type (the filesystem object gets valid) */
 	fs->id = ++Fsid;		/* Volume mount ID */
 #if FF_USE_LFN == 1
@@ -3635,6 +5350,14 @@ static FRESULT validate (	/* Returns FR_OK or FR_INVALID_OBJECT */
 		if (!(disk_status(obj->fs->pdrv) & STA_NOINIT)) { /* Test if the hosting phsical drive is kept initialized */
 			res = FR_OK;
 		}
+#endif
+#if FF_USE_ASYNC
+		if (res == FR_OK && obj->fs->abusy) {	/* Reject it while an asynchronous transfer is in progress */
+#if FF_FS_REENTRANT
+			unlock_volume(obj->fs, FR_OK);
+#endif
+			res = FR_LOCKED;
+		}
 #endif
 	}
 	*rfs = (res == FR_OK) ? obj->fs : 0;	/* Return corresponding filesystem object if it is valid */
@@ -3674,6 +5397,15 @@ FRESULT f_mount (
 	cfs = FatFs[vol];			/* Pointer to the filesystem object of the volume */
 
 	if (cfs) {					/* Unregister current filesystem object if regsitered */
+#if FF_LAZY_FAT2 && !FF_FS_READONLY
+#if FF_FS_REENTRANT
+		if (!lock_volume(cfs, 0)) return FR_TIMEOUT;	/* Lock the volume against the task using it */
+#endif
+		if (cfs->fs_type != 0 && cfs->n_mirror != 0) sync_fs(cfs);	/* Reflect pending changes to the 2nd FAT */
+#if FF_FS_REENTRANT
+		unlock_volume(cfs, FR_OK);
+#endif
+#endif
 		FatFs[vol] = 0;
 #if FF_FS_LOCK
 		clear_share(cfs);
@@ -3700,6 +5432,9 @@ FRESULT f_mount (
 #endif
 #endif
 		fs->fs_type = 0;		/* Invalidate the new filesystem object */
+#if FF_USE_ASYNC
+		fs->abusy = 0;
+#endif
 		FatFs[vol] = fs;		/* Register new fs object */
 	}
 
@@ -3716,10 +5451,12 @@ FRESULT f_mount (
 /* Open or Create a File                                                 */
 /*-----------------------------------------------------------------------*/
 
-FRESULT f_open (
+FRESULT f_open_ex (
 	FIL* fp,			/* Pointer to the blank file object */
 	const TCHAR* path,	/* Pointer to the file name */
-	BYTE mode			/* Access mode and open mode flags */
+	BYTE mode,			/* Access mode and open mode flags */
+	void* buff,			/* Pointer to the data buffer for the file (null:built-in buffer) */
+	UINT len			/* Size of the data buffer in unit of byte */
 )
 {
 	FRESULT res;
@@ -3738,6 +5475,7 @@ FRESULT f_open (
 	/* Get logical drive number */
 	mode &= FF_FS_READONLY ? FA_READ : FA_READ | FA_WRITE | FA_CREATE_ALWAYS | FA_CREATE_NEW | FA_OPEN_ALWAYS | FA_OPEN_APPEND;
 	res = mount_volume(&path, &fs, mode);
+	if (res == FR_OK && buff && len < SS(fs)) res = FR_INVALID_PARAMETER;	/* Given buffer must have a sector at least (checked at tiny cfg as well) */
 	if (res == FR_OK) {
 		dj.obj.fs = fs;
 		INIT_NAMBUF(fs);
@@ -3859,6 +5597,12 @@ FRESULT f_open (
 			}
 #if FF_USE_FASTSEEK
 			fp->cltbl = 0;		/* Disable fast seek mode */
+#endif
+#if FF_FASTSEEK_AUTO
+			fp->xcnt = 0; fp->xfrag = 0; fp->xfull = 0;	/* Automatic link map is blank */
+#endif
+#if FF_READAHEAD
+			fp->ranext = 0;		/* No sequential access yet */
 #endif
 			fp->obj.fs = fs;	/* Validate the file object */
 			fp->obj.id = fs->id;
@@ -3866,9 +5610,17 @@ FRESULT f_open (
 			fp->err = 0;		/* Clear error flag */
 			fp->sect = 0;		/* Invalidate current data sector */
 			fp->fptr = 0;		/* Set file pointer top of the file */
+#if !FF_FS_TINY
+			if (buff) {			/* Set data window */
+				fp->buf = (BYTE*)buff; fp->bmax = len / SS(fs);
+			} else {
+				fp->buf = fp->ibuf; fp->bmax = FF_FIL_BUF;
+			}
+			fp->bcnt = fp->bidx = 0;
+#endif
 #if !FF_FS_READONLY
 #if !FF_FS_TINY
-			memset(fp->buf, 0, sizeof fp->buf);	/* Clear sector buffer */
+			memset(fp->buf, 0, (size_t)fp->bmax * SS(fs));	/* Clear data window */
 #endif
 			if ((mode & FA_SEEKEND) && fp->obj.objsize > 0) {	/* Seek to end of file if FA_OPEN_APPEND is specified */
 				fp->fptr = fp->obj.objsize;			/* Offset to seek */
@@ -3888,6 +5640,7 @@ FRESULT f_open (
 						fp->sect = sc + (DWORD)(ofs / SS(fs));
 #if !FF_FS_TINY
 						if (disk_read(fs->pdrv, fp->buf, fp->sect, 1) != RES_OK) res = FR_DISK_ERR;
+						fp->bcnt = 1;
 #endif
 					}
 				}
@@ -3895,6 +5648,9 @@ FRESULT f_open (
 				if (res != FR_OK) dec_share(fp->obj.lockid); /* Decrement file open counter if seek failed */
 #endif
 			}
+#if FF_CLST_RESERVE
+			if (res == FR_OK && (mode & FA_WRITE)) rsv_open(fs, &fp->obj);	/* Register the file to reserve clusters ahead of the growing edge */
+#endif
 #endif
 		}
 
@@ -3907,6 +5663,16 @@ FRESULT f_open (
 }
 
 
+FRESULT f_open (
+	FIL* fp,			/* Pointer to the blank file object */
+	const TCHAR* path,	/* Pointer to the file name */
+	BYTE mode			/* Access mode and open mode flags */
+)
+{
+	return f_open_ex(fp, path, mode, 0, 0);	/* Open the file with the built-in data buffer */
+}
+
+
 
 
 /*-----------------------------------------------------------------------*/
@@ -3927,6 +5693,10 @@ FRESULT f_read (
 	FSIZE_t remain;
 	UINT rcnt, cc, csect;
 	BYTE *rbuff = (BYTE*)buff;
+#if FF_DISK_VEC
+	DSEG seg[FF_DISK_VEC];
+	UINT ns;
+#endif
 
 
 	*br = 0;	/* Clear read byte counter */
@@ -3947,6 +5717,11 @@ FRESULT f_read (
 					if (fp->cltbl) {
 						clst = clmt_clust(fp, fp->fptr);	/* Get cluster# from the CLMT */
 					} else
+#endif
+#if FF_FASTSEEK_AUTO
+					if (fp->fptr / SS(fs) / fs->csize < fp->xcnt) {
+						clst = map_clust(fp, (DWORD)(fp->fptr / SS(fs) / fs->csize));	/* Get cluster# from the link map */
+					} else
 #endif
 					{
 						clst = get_fat(&fp->obj, fp->clust);	/* Follow cluster chain on the FAT */
@@ -3961,36 +5736,101 @@ FRESULT f_read (
 			sect += csect;
 			cc = btr / SS(fs);					/* When remaining bytes >= sector size, */
 			if (cc > 0) {						/* Read maximum contiguous sectors directly */
+#if FF_READAHEAD
+				if (cc < FF_READAHEAD && read_ahead(fp, sect, cc) != FR_OK) ABORT(fs, FR_DISK_ERR);	/* Prefetch the following sectors on sequential read */
+				if (sect - fs->rasect < fs->racnt) {	/* In the read-ahead buffer? Clip at end of the buffer and the cluster */
+					rcnt = fs->racnt - (UINT)(sect - fs->rasect);
+					if (cc > rcnt) cc = rcnt;
+					if (csect + cc > fs->csize) cc = fs->csize - csect;
+				}
+#endif
+#if FF_DISK_VEC
+				seg[0].sector = sect; seg[0].buff = rbuff; ns = 1;
+#endif
 				if (csect + cc > fs->csize) {	/* Clip at cluster boundary */
 					cc = fs->csize - csect;
+					while (cc < btr / SS(fs)) {	/* Extend it over the following clusters while they are contiguous */
+#if FF_USE_FASTSEEK
+						if (fp->cltbl) {
+							clst = clmt_clust(fp, fp->fptr + (FSIZE_t)cc * SS(fs));	/* Get cluster# from the CLMT */
+						} else
+#endif
+						{
+							clst = get_fat(&fp->obj, fp->clust);	/* Follow cluster chain on the FAT */
+						}
+						if (clst != fp->clust + 1 || clst >= fs->n_fatent) {	/* Not contiguous? (errors are checked at next cluster boundary) */
+#if FF_DISK_VEC
+							if (ns < FF_DISK_VEC && clst >= 2 && clst < fs->n_fatent) {	/* Continue it at the next fragment in a new segment */
+								seg[ns].sector = clst2sect(fs, clst); seg[ns].buff = rbuff + SS(fs) * cc; ns++;
+								fp->clust = clst;
+								cc += fs->csize;
+								continue;
+							}
+#endif
+							break;
+						}
+						fp->clust = clst;
+						cc += fs->csize;
+					}
+					if (cc > btr / SS(fs)) cc = btr / SS(fs);
 				}
-				if (disk_read(fs->pdrv, rbuff, sect, cc) != RES_OK) ABORT(fs, FR_DISK_ERR);
-#if !FF_FS_READONLY && FF_FS_MINIMIZE <= 2		/* Replace one of the read sectors with cached data if it contains a dirty sector */
-#if FF_FS_TINY
-				if (fs->wflag && fs->winsect - sect < cc) {
-					memcpy(rbuff + ((fs->winsect - sect) * SS(fs)), fs->win, SS(fs));
+#if FF_DISK_VEC
+				for (csect = 0; csect < ns; csect++) {	/* Get number of sectors in each segment */
+					seg[csect].count = (UINT)(((csect + 1 < ns) ? seg[csect + 1].buff : rbuff + SS(fs) * cc) - seg[csect].buff) / SS(fs);
 				}
+#endif
+#if FF_READAHEAD
+				if (sect - fs->rasect < fs->racnt) {	/* Read the sectors from the read-ahead buffer */
+					memcpy(rbuff, fs->rabuf + (sect - fs->rasect) * SS(fs), SS(fs) * cc);
+					fs->rahit = 1;
+				} else
+#endif
+				{
+#if FF_DISK_VEC
+#if !FF_FS_TINY
+					if (ns < FF_DISK_VEC && cc == btr / SS(fs) && btr % SS(fs) != 0 && ((fp->fptr / SS(fs) + cc) & (fs->csize - 1)) != 0 && !(fp->flag & FA_DIRTY)) {	/* Read the last partial sector in the same cluster into the window in the same request */
+						seg[ns].sector = seg[ns - 1].sector + seg[ns - 1].count;
+						if (seg[ns].sector - fp->sect >= fp->bcnt) {	/* Not in the window? */
+							seg[ns].buff = fp->buf; seg[ns].count = 1;
+							fp->sect = seg[ns++].sector; fp->bcnt = 0;	/* The window is invalid until the transfer succeeds */
+						}
+					}
+#endif
+					if (xfer_vec(fs, seg, ns, 0) != RES_OK) ABORT(fs, FR_DISK_ERR);
+#if !FF_FS_TINY
+					if (seg[ns - 1].buff == fp->buf) {	/* The window has been loaded */
+						fp->bcnt = 1; ns--;
+					}
+#endif
 #else
-				if ((fp->flag & FA_DIRTY) && fp->sect - sect < cc) {
-					memcpy(rbuff + ((fp->sect - sect) * SS(fs)), fp->buf, SS(fs));
+					if (disk_read(fs->pdrv, rbuff, sect, cc) != RES_OK) ABORT(fs, FR_DISK_ERR);
+#endif
 				}
+#if FF_READAHEAD
+#if FF_DISK_VEC
+				fp->ranext = seg[ns - 1].sector + seg[ns - 1].count;	/* Continue sequential access detection */
+#else
+				fp->ranext = sect + cc;			/* Continue sequential access detection */
+#endif
+#endif
+#if !FF_FS_READONLY && FF_FS_MINIMIZE <= 2		/* Replace the read sectors with cached data if it contains a dirty sector */
+#if FF_DISK_VEC
+				for (csect = 0; csect < ns; csect++) merge_dirty(fp, seg[csect].sector, seg[csect].buff, seg[csect].count);
+#else
+				merge_dirty(fp, sect, rbuff, cc);
 #endif
 #endif
 				rcnt = SS(fs) * cc;				/* Number of bytes transferred */
 				continue;
 			}
 #if !FF_FS_TINY
-			if (fp->sect != sect) {			/* Load data sector if not in cache */
-#if !FF_FS_READONLY
-				if (fp->flag & FA_DIRTY) {		/* Write-back dirty sector cache */
-					if (disk_write(fs->pdrv, fp->buf, fp->sect, 1) != RES_OK) ABORT(fs, FR_DISK_ERR);
-					fp->flag &= (BYTE)~FA_DIRTY;
-				}
-#endif
-				if (disk_read(fs->pdrv, fp->buf, sect, 1) != RES_OK) ABORT(fs, FR_DISK_ERR);	/* Fill sector cache */
-			}
+			if (fill_buf(fp, sect, 0) != FR_OK) ABORT(fs, FR_DISK_ERR);	/* Load data sector if not in the window */
+#else
+#if FF_READAHEAD
+			if (fs->winsect != sect && read_ahead(fp, sect, 1) != FR_OK) ABORT(fs, FR_DISK_ERR);	/* Prefetch the following sectors on sequential read */
 #endif
 			fp->sect = sect;
+#endif
 		}
 		rcnt = SS(fs) - (UINT)fp->fptr % SS(fs);	/* Number of bytes remains in the sector */
 		if (rcnt > btr) rcnt = btr;					/* Clip it by btr if needed */
@@ -3998,12 +5838,167 @@ FRESULT f_read (
 		if (move_window(fs, fp->sect) != FR_OK) ABORT(fs, FR_DISK_ERR);	/* Move sector window */
 		memcpy(rbuff, fs->win + fp->fptr % SS(fs), rcnt);	/* Extract partial sector */
 #else
-		memcpy(rbuff, fp->buf + fp->fptr % SS(fs), rcnt);	/* Extract partial sector */
+		memcpy(rbuff, fp->buf + fp->bidx * SS(fs) + fp->fptr % SS(fs), rcnt);	/* Extract partial sector */
+#endif
+	}
+
+	LEAVE_FF(fs, FR_OK);
+}
+
+
+
+
+#if FF_USE_ASYNC
+/*-----------------------------------------------------------------------*/
+/* Start to Read File                                                    */
+/*-----------------------------------------------------------------------*/
+
+FRESULT f_read_async (
+	FIL* fp, 	/* Open file to be read */
+	void* buff,	/* Data buffer to store the read data (must be kept until completion) */
+	UINT btr,	/* Number of bytes to read */
+	FF_AREQ* req	/* Request to be notified the completion */
+)
+{
+	FRESULT res;
+	FATFS *fs;
+	LBA_t sect;
+	FSIZE_t remain;
+	UINT cc;
+	DRESULT dr;
+
+
+	if (!req) return FR_INVALID_PARAMETER;
+	req->fp = fp; req->nb = 0; req->done = 0;
+	res = validate(&fp->obj, &fs);				/* Check validity of the file object */
+	if (res != FR_OK || (res = (FRESULT)fp->err) != FR_OK) LEAVE_FF(fs, res);	/* Check validity */
+	if (!(fp->flag & FA_READ)) LEAVE_FF(fs, FR_DENIED); /* Check access mode */
+	remain = fp->obj.objsize - fp->fptr;
+	if (btr > remain) btr = (UINT)remain;		/* Truncate btr by remaining bytes */
+
+	res = async_run(fp, btr, 0, &sect, &cc);	/* Get contiguous sectors at the file pointer */
+	if (res != FR_OK) ABORT(fs, res);
+	if (cc == 0) {								/* No whole sector at the file pointer? */
+		cc = SS(fs) - (UINT)(fp->fptr % SS(fs));
+		if (btr > cc) btr = cc;					/* Clip it at the sector boundary */
+#if FF_FS_REENTRANT
+		unlock_volume(fs, FR_OK);
+#endif
+		res = f_read(fp, buff, btr, &req->nb);	/* Read the partial sector in blocking mode */
+		if (res == FR_OK) async_done(req, RES_OK);
+		return res;
+	}
+#if !FF_FS_READONLY	/* Write-back the dirty sectors in the run prior to the transfer */
+#if FF_FS_TINY
+	if (fs->winsect - sect < cc && sync_window(fs) != FR_OK) ABORT(fs, FR_DISK_ERR);
+#if FF_WIN_CACHE
+	if (sync_cache(fs) != FR_OK) ABORT(fs, FR_DISK_ERR);
+#endif
+#else
+	if ((fp->flag & FA_DIRTY) && (fp->sect - sect < cc || sect - fp->sect < fp->bcnt) && flush_buf(fp) != FR_OK) ABORT(fs, FR_DISK_ERR);
+#endif
 #endif
+	req->nb = SS(fs) * cc;
+	fp->fptr += req->nb;						/* Advance the file pointer prior to the transfer */
+	fs->abusy = 1;								/* Lock out the volume until the transfer completes */
+	dr = disk_read_async(fs->pdrv, (BYTE*)buff, sect, cc, async_done, req);
+	if (dr == RES_PARERR) {						/* Not supported by the disk I/O layer? */
+		fs->abusy = 0;
+		dr = disk_read(fs->pdrv, (BYTE*)buff, sect, cc);	/* Read the sectors in blocking mode */
+		if (dr == RES_OK) async_done(req, RES_OK);
+	}
+	if (dr != RES_OK) {
+		fs->abusy = 0;
+		ABORT(fs, FR_DISK_ERR);
 	}
 
 	LEAVE_FF(fs, FR_OK);
 }
+#endif
+
+
+
+
+#if FF_USE_MAP
+/*-----------------------------------------------------------------------*/
+/* Map File Data                                                         */
+/*-----------------------------------------------------------------------*/
+
+FRESULT f_read_map (
+	FIL* fp, 			/* Open file to be read */
+	const void** buff,	/* Pointer to the variable to return the pointer to the file data */
+	UINT btr,			/* Number of bytes to read */
+	UINT* br			/* Number of bytes mapped (up to end of the sector) */
+)
+{
+	FRESULT res;
+	FATFS *fs;
+	DWORD clst;
+	LBA_t sect;
+	FSIZE_t remain;
+	UINT rcnt, csect;
+	BYTE *dbuf;
+
+
+	*buff = 0; *br = 0;	/* Clear mapped byte counter */
+	res = validate(&fp->obj, &fs);				/* Check validity of the file object */
+	if (res != FR_OK || (res = (FRESULT)fp->err) != FR_OK) LEAVE_FF(fs, res);	/* Check validity */
+	if (!(fp->flag & FA_READ)) LEAVE_FF(fs, FR_DENIED); /* Check access mode */
+	remain = fp->obj.objsize - fp->fptr;
+	if (btr > remain) btr = (UINT)remain;		/* Truncate btr by remaining bytes */
+	if (btr == 0) LEAVE_FF(fs, FR_OK);			/* End of the file? */
+
+	if (fp->fptr % SS(fs) == 0) {				/* On the sector boundary? */
+		csect = (UINT)(fp->fptr / SS(fs) & (fs->csize - 1));	/* Sector offset in the cluster */
+		if (csect == 0) {						/* On the cluster boundary? */
+			if (fp->fptr == 0) {				/* On the top of the file? */
+				clst = fp->obj.sclust;			/* Follow cluster chain from the origin */
+			} else {							/* Middle or end of the file */
+#if FF_USE_FASTSEEK
+				if (fp->cltbl) {
+					clst = clmt_clust(fp, fp->fptr);	/* Get cluster# from the CLMT */
+				} else
+#endif
+#if FF_FASTSEEK_AUTO
+				if (fp->fptr / SS(fs) / fs->csize < fp->xcnt) {
+					clst = map_clust(fp, (DWORD)(fp->fptr / SS(fs) / fs->csize));	/* Get cluster# from the link map */
+				} else
+#endif
+				{
+					clst = get_fat(&fp->obj, fp->clust);	/* Follow cluster chain on the FAT */
+				}
+			}
+			if (clst < 2) ABORT(fs, FR_INT_ERR);
+			if (clst == 0xFFFFFFFF) ABORT(fs, FR_DISK_ERR);
+			fp->clust = clst;					/* Update current cluster */
+		}
+		sect = clst2sect(fs, fp->clust);		/* Get current sector */
+		if (sect == 0) ABORT(fs, FR_INT_ERR);
+		sect += csect;
+#if !FF_FS_TINY
+		if (fill_buf(fp, sect, 0) != FR_OK) ABORT(fs, FR_DISK_ERR);	/* Load data sector if not in the window */
+#else
+#if FF_READAHEAD
+		if (fs->winsect != sect && read_ahead(fp, sect, 1) != FR_OK) ABORT(fs, FR_DISK_ERR);	/* Prefetch the following sectors on sequential read */
+#endif
+		fp->sect = sect;
+#endif
+	}
+#if FF_FS_TINY
+	if (move_window(fs, fp->sect) != FR_OK) ABORT(fs, FR_DISK_ERR);	/* Move sector window */
+	dbuf = fs->win;
+#else
+	dbuf = fp->buf + fp->bidx * SS(fs);
+#endif
+	rcnt = SS(fs) - (UINT)fp->fptr % SS(fs);	/* Number of bytes remains in the sector */
+	if (rcnt > btr) rcnt = btr;					/* Clip it by btr if needed */
+	*buff = dbuf + fp->fptr % SS(fs);			/* Return the file data in the sector buffer */
+	*br = rcnt;
+	fp->fptr += rcnt;
+
+	LEAVE_FF(fs, FR_OK);
+}
+#endif
 
 
 
@@ -4022,10 +6017,14 @@ FRESULT f_write (
 {
 	FRESULT res;
 	FATFS *fs;
-	DWORD clst;
+	DWORD clst, nclst = 0;
 	LBA_t sect;
 	UINT wcnt, cc, csect;
 	const BYTE *wbuff = (const BYTE*)buff;
+#if FF_DISK_VEC
+	DSEG seg[FF_DISK_VEC];
+	UINT ns;
+#endif
 
 
 	*bw = 0;	/* Clear write byte counter */
@@ -4048,84 +6047,314 @@ FRESULT f_write (
 						clst = create_chain(&fp->obj, 0);	/* create a new cluster chain */
 					}
 				} else {					/* On the middle or end of the file */
+					if (nclst != 0) {		/* Next cluster has been got at previous transfer? */
+						clst = nclst; nclst = 0;
+					} else
+#if FF_USE_FASTSEEK
+					if (fp->cltbl) {
+						clst = clmt_clust(fp, fp->fptr);	/* Get cluster# from the CLMT */
+					} else
+#endif
+					{
+						clst = create_chain(&fp->obj, fp->clust);	/* Follow or stretch cluster chain on the FAT */
+					}
+				}
+				if (clst == 0) break;		/* Could not allocate a new cluster (disk full) */
+				if (clst == 1) ABORT(fs, FR_INT_ERR);
+				if (clst == 0xFFFFFFFF) ABORT(fs, FR_DISK_ERR);
+				fp->clust = clst;			/* Update current cluster */
+				if (fp->obj.sclust == 0) fp->obj.sclust = clst;	/* Set start cluster if the first write */
+			}
+#if FF_FS_TINY
+			if (fs->winsect == fp->sect && sync_window(fs) != FR_OK) ABORT(fs, FR_DISK_ERR);	/* Write-back sector cache */
+#endif
+			sect = clst2sect(fs, fp->clust);	/* Get current sector */
+			if (sect == 0) ABORT(fs, FR_INT_ERR);
+			sect += csect;
+			cc = btw / SS(fs);				/* When remaining bytes >= sector size, */
+			if (cc > 0) {					/* Write maximum contiguous sectors directly */
+#if FF_DISK_VEC
+				seg[0].sector = sect; seg[0].buff = (BYTE*)wbuff; ns = 1;
+#endif
+				if (csect + cc > fs->csize) {	/* Clip at cluster boundary */
+					cc = fs->csize - csect;
+					while (cc < btw / SS(fs)) {	/* Extend it over the following clusters while they are contiguous */
+#if FF_USE_FASTSEEK
+						if (fp->cltbl) {
+							clst = clmt_clust(fp, fp->fptr + (FSIZE_t)cc * SS(fs));	/* Get cluster# from the CLMT */
+						} else
+#endif
+						{
+							if (FF_FS_EXFAT && fp->fptr + (FSIZE_t)cc * SS(fs) > fp->obj.objsize) {	/* No FAT chain object needs correct objsize to generate FAT value */
+								fp->obj.objsize = fp->fptr + (FSIZE_t)cc * SS(fs);
+							}
+							clst = create_chain(&fp->obj, fp->clust);	/* Follow or stretch cluster chain on the FAT */
+						}
+						if (clst != fp->clust + 1 || clst >= fs->n_fatent) {	/* Not contiguous? */
+#if FF_DISK_VEC
+							if (ns < FF_DISK_VEC && clst >= 2 && clst < fs->n_fatent) {	/* Continue it at the next fragment in a new segment */
+								seg[ns].sector = clst2sect(fs, clst); seg[ns].buff = (BYTE*)wbuff + SS(fs) * cc; ns++;
+								fp->clust = clst;
+								cc += fs->csize;
+								continue;
+							}
+#endif
+							nclst = clst;	/* Hold the result for next cluster boundary (the growing edge of exFAT cannot be followed again) */
+							break;
+						}
+						fp->clust = clst;
+						cc += fs->csize;
+					}
+					if (cc > btw / SS(fs)) cc = btw / SS(fs);
+				}
+#if FF_DISK_VEC
+				for (csect = 0; csect < ns; csect++) {	/* Get number of sectors in each segment */
+					seg[csect].count = (UINT)(((csect + 1 < ns) ? seg[csect + 1].buff : (BYTE*)wbuff + SS(fs) * cc) - seg[csect].buff) / SS(fs);
+				}
+#if !FF_FS_TINY
+				if ((fp->flag & FA_DIRTY) && ns < FF_DISK_VEC) {	/* Write-back the file data window in the same request if it is not overlapped */
+					for (csect = 0; csect < ns && fp->sect - seg[csect].sector >= seg[csect].count && seg[csect].sector - fp->sect >= fp->bcnt; csect++) ;
+					if (csect == ns) {
+						for ( ; csect > 0; csect--) seg[csect] = seg[csect - 1];
+						seg[0].sector = fp->sect; seg[0].buff = fp->buf; seg[0].count = fp->bcnt; ns++;
+						fp->flag &= (BYTE)~FA_DIRTY;
+					}
+				}
+#endif
+#endif
+#if !FF_FS_TINY
+				if (flush_buf(fp) != FR_OK) ABORT(fs, FR_DISK_ERR);	/* Write-back the file data window */
+#endif
+#if FF_DISK_VEC
+				if (xfer_vec(fs, seg, ns, 1) != RES_OK) ABORT(fs, FR_DISK_ERR);
+				for (csect = 0; csect < ns; csect++) {
+#if !FF_FS_TINY
+					if (seg[csect].buff == fp->buf) {	/* The file data window has been written back */
+#if FF_READAHEAD
+						inval_cache(fs, fp->sect, fp->bcnt);	/* Discard stale read-ahead data */
+#endif
+						continue;
+					}
+#endif
+#if FF_FS_MINIMIZE <= 2
+					put_direct(fp, seg[csect].sector, seg[csect].buff, seg[csect].count);
+#elif FF_WIN_CACHE || FF_READAHEAD
+					inval_cache(fs, seg[csect].sector, seg[csect].count);	/* Discard cached copies overwritten by the direct write */
+#endif
+				}
+#else
+				if (disk_write(fs->pdrv, wbuff, sect, cc) != RES_OK) ABORT(fs, FR_DISK_ERR);
+#if FF_FS_MINIMIZE <= 2
+				put_direct(fp, sect, wbuff, cc);
+#elif FF_WIN_CACHE || FF_READAHEAD
+				inval_cache(fs, sect, cc);	/* Discard cached copies overwritten by the direct write */
+#endif
+#endif
+				wcnt = SS(fs) * cc;		/* Number of bytes transferred */
+				continue;
+			}
+#if FF_FS_TINY
+			if (fp->fptr >= fp->obj.objsize) {	/* Avoid silly cache filling on the growing edge */
+				if (sync_window(fs) != FR_OK) ABORT(fs, FR_DISK_ERR);
+#if FF_WIN_CACHE
+				inval_cache(fs, sect, 1);
+#endif
+				fs->winsect = sect;
+			}
+			fp->sect = sect;
+#else
+			if (fill_buf(fp, sect, 1) != FR_OK) ABORT(fs, FR_DISK_ERR);	/* Fill sector cache with file data or collect it next to the dirty sectors */
+#endif
+		}
+		wcnt = SS(fs) - (UINT)fp->fptr % SS(fs);	/* Number of bytes remains in the sector */
+		if (wcnt > btw) wcnt = btw;					/* Clip it by btw if needed */
+#if FF_FS_TINY
+		if (move_window(fs, fp->sect) != FR_OK) ABORT(fs, FR_DISK_ERR);	/* Move sector window */
+		memcpy(fs->win + fp->fptr % SS(fs), wbuff, wcnt);	/* Fit data to the sector */
+		fs->wflag = 1;
+#else
+		memcpy(fp->buf + fp->bidx * SS(fs) + fp->fptr % SS(fs), wbuff, wcnt);	/* Fit data to the sector */
+		fp->flag |= FA_DIRTY;
+#endif
+	}
+
+	fp->flag |= FA_MODIFIED;				/* Set file change flag */
+
+	LEAVE_FF(fs, FR_OK);
+}
+
+
+
+
+#if FF_USE_ASYNC
+/*-----------------------------------------------------------------------*/
+/* Start to Write File                                                   */
+/*-----------------------------------------------------------------------*/
+
+FRESULT f_write_async (
+	FIL* fp,			/* Open file to be written */
+	const void* buff,	/* Data to be written (must be kept until completion) */
+	UINT btw,			/* Number of bytes to write */
+	FF_AREQ* req		/* Request to be notified the completion */
+)
+{
+	FRESULT res;
+	FATFS *fs;
+	LBA_t sect;
+	UINT cc;
+	DRESULT dr;
+	const BYTE *wbuff = (const BYTE*)buff;
+
+
+	if (!req) return FR_INVALID_PARAMETER;
+	req->fp = fp; req->nb = 0; req->done = 0;
+	res = validate(&fp->obj, &fs);			/* Check validity of the file object */
+	if (res != FR_OK || (res = (FRESULT)fp->err) != FR_OK) LEAVE_FF(fs, res);	/* Check validity */
+	if (!(fp->flag & FA_WRITE)) LEAVE_FF(fs, FR_DENIED);	/* Check access mode */
+
+	/* Check fptr wrap-around (file size cannot reach 4 GiB at FAT volume) */
+	if ((!FF_FS_EXFAT || fs->fs_type != FS_EXFAT) && (DWORD)(fp->fptr + btw) < (DWORD)fp->fptr) {
+		btw = (UINT)(0xFFFFFFFF - (DWORD)fp->fptr);
+	}
+
+	res = async_run(fp, btw, 1, &sect, &cc);	/* Get contiguous sectors at the file pointer (stretch the chain if needed) */
+	if (res != FR_OK) ABORT(fs, res);
+	if (cc == 0) {							/* No whole sector at the file pointer? */
+		cc = SS(fs) - (UINT)(fp->fptr % SS(fs));
+		if (btw > cc) btw = cc;				/* Clip it at the sector boundary */
+#if FF_FS_REENTRANT
+		unlock_volume(fs, FR_OK);
+#endif
+		res = f_write(fp, buff, btw, &req->nb);	/* Write the partial sector in blocking mode */
+		if (res == FR_OK) async_done(req, RES_OK);
+		return res;
+	}
+#if FF_FS_TINY
+	if (fs->winsect == fp->sect && sync_window(fs) != FR_OK) ABORT(fs, FR_DISK_ERR);	/* Write-back sector cache */
+#else
+	if (flush_buf(fp) != FR_OK) ABORT(fs, FR_DISK_ERR);	/* Write-back the file data window */
+#endif
+#if FF_FS_MINIMIZE <= 2
+	put_direct(fp, sect, wbuff, cc);		/* Refill the cached copies with the data to be written */
+#elif FF_WIN_CACHE || FF_READAHEAD
+	inval_cache(fs, sect, cc);				/* Discard cached copies overwritten by the transfer */
+#endif
+	req->nb = SS(fs) * cc;
+	fp->fptr += req->nb;					/* Advance the file pointer prior to the transfer */
+	if (fp->fptr > fp->obj.objsize) fp->obj.objsize = fp->fptr;
+	fp->flag |= FA_MODIFIED;				/* Set file change flag */
+	fs->abusy = 1;							/* Lock out the volume until the transfer completes */
+	dr = disk_write_async(fs->pdrv, wbuff, sect, cc, async_done, req);
+	if (dr == RES_PARERR) {					/* Not supported by the disk I/O layer? */
+		fs->abusy = 0;
+		dr = disk_write(fs->pdrv, wbuff, sect, cc);	/* Write the sectors in blocking mode */
+		if (dr == RES_OK) async_done(req, RES_OK);
+	}
+	if (dr != RES_OK) {
+		fs->abusy = 0;
+		ABORT(fs, FR_DISK_ERR);
+	}
+
+	LEAVE_FF(fs, FR_OK);
+}
+#endif
+
+
+
+
+#if FF_USE_MAP
+/*-----------------------------------------------------------------------*/
+/* Claim Buffer to Write File Data                                       */
+/*-----------------------------------------------------------------------*/
+
+FRESULT f_write_claim (
+	FIL* fp,			/* Open file to be written */
+	void** buff,		/* Pointer to the variable to return the pointer to the buffer */
+	UINT btw,			/* Number of bytes to write */
+	UINT* bw			/* Number of bytes claimed (up to end of the sector) */
+)
+{
+	FRESULT res;
+	FATFS *fs;
+	DWORD clst;
+	LBA_t sect;
+	UINT wcnt, csect;
+	BYTE *dbuf;
+
+
+	*buff = 0; *bw = 0;	/* Clear claimed byte counter */
+	res = validate(&fp->obj, &fs);			/* Check validity of the file object */
+	if (res != FR_OK || (res = (FRESULT)fp->err) != FR_OK) LEAVE_FF(fs, res);	/* Check validity */
+	if (!(fp->flag & FA_WRITE)) LEAVE_FF(fs, FR_DENIED);	/* Check access mode */
+
+	/* Check fptr wrap-around (file size cannot reach 4 GiB at FAT volume) */
+	if ((!FF_FS_EXFAT || fs->fs_type != FS_EXFAT) && (DWORD)(fp->fptr + btw) < (DWORD)fp->fptr) {
+		btw = (UINT)(0xFFFFFFFF - (DWORD)fp->fptr);
+	}
+	if (btw == 0) LEAVE_FF(fs, FR_OK);
+
+	if (fp->fptr % SS(fs) == 0) {		/* On the sector boundary? */
+		csect = (UINT)(fp->fptr / SS(fs)) & (fs->csize - 1);	/* Sector offset in the cluster */
+		if (csect == 0) {				/* On the cluster boundary? */
+			if (fp->fptr == 0) {		/* On the top of the file? */
+				clst = fp->obj.sclust;	/* Follow from the origin */
+				if (clst == 0) {		/* If no cluster is allocated, */
+					clst = create_chain(&fp->obj, 0);	/* create a new cluster chain */
+				}
+			} else {					/* On the middle or end of the file */
 #if FF_USE_FASTSEEK
-					if (fp->cltbl) {
-						clst = clmt_clust(fp, fp->fptr);	/* Get cluster# from the CLMT */
-					} else
+				if (fp->cltbl) {
+					clst = clmt_clust(fp, fp->fptr);	/* Get cluster# from the CLMT */
+				} else
 #endif
-					{
-						clst = create_chain(&fp->obj, fp->clust);	/* Follow or stretch cluster chain on the FAT */
-					}
+				{
+					clst = create_chain(&fp->obj, fp->clust);	/* Follow or stretch cluster chain on the FAT */
 				}
-				if (clst == 0) break;		/* Could not allocate a new cluster (disk full) */
-				if (clst == 1) ABORT(fs, FR_INT_ERR);
-				if (clst == 0xFFFFFFFF) ABORT(fs, FR_DISK_ERR);
-				fp->clust = clst;			/* Update current cluster */
-				if (fp->obj.sclust == 0) fp->obj.sclust = clst;	/* Set start cluster if the first write */
 			}
+			if (clst == 0) LEAVE_FF(fs, FR_OK);	/* Could not allocate a new cluster (disk full) */
+			if (clst == 1) ABORT(fs, FR_INT_ERR);
+			if (clst == 0xFFFFFFFF) ABORT(fs, FR_DISK_ERR);
+			fp->clust = clst;			/* Update current cluster */
+			if (fp->obj.sclust == 0) fp->obj.sclust = clst;	/* Set start cluster if the first write */
+		}
 #if FF_FS_TINY
-			if (fs->winsect == fp->sect && sync_window(fs) != FR_OK) ABORT(fs, FR_DISK_ERR);	/* Write-back sector cache */
-#else
-			if (fp->flag & FA_DIRTY) {		/* Write-back sector cache */
-				if (disk_write(fs->pdrv, fp->buf, fp->sect, 1) != RES_OK) ABORT(fs, FR_DISK_ERR);
-				fp->flag &= (BYTE)~FA_DIRTY;
-			}
-#endif
-			sect = clst2sect(fs, fp->clust);	/* Get current sector */
-			if (sect == 0) ABORT(fs, FR_INT_ERR);
-			sect += csect;
-			cc = btw / SS(fs);				/* When remaining bytes >= sector size, */
-			if (cc > 0) {					/* Write maximum contiguous sectors directly */
-				if (csect + cc > fs->csize) {	/* Clip at cluster boundary */
-					cc = fs->csize - csect;
-				}
-				if (disk_write(fs->pdrv, wbuff, sect, cc) != RES_OK) ABORT(fs, FR_DISK_ERR);
-#if FF_FS_MINIMIZE <= 2
-#if FF_FS_TINY
-				if (fs->winsect - sect < cc) {	/* Refill sector cache if it gets invalidated by the direct write */
-					memcpy(fs->win, wbuff + ((fs->winsect - sect) * SS(fs)), SS(fs));
-					fs->wflag = 0;
-				}
-#else
-				if (fp->sect - sect < cc) { /* Refill sector cache if it gets invalidated by the direct write */
-					memcpy(fp->buf, wbuff + ((fp->sect - sect) * SS(fs)), SS(fs));
-					fp->flag &= (BYTE)~FA_DIRTY;
-				}
-#endif
+		if (fs->winsect == fp->sect && sync_window(fs) != FR_OK) ABORT(fs, FR_DISK_ERR);	/* Write-back sector cache */
 #endif
-				wcnt = SS(fs) * cc;		/* Number of bytes transferred */
-				continue;
-			}
+		sect = clst2sect(fs, fp->clust);	/* Get current sector */
+		if (sect == 0) ABORT(fs, FR_INT_ERR);
+		sect += csect;
 #if FF_FS_TINY
-			if (fp->fptr >= fp->obj.objsize) {	/* Avoid silly cache filling on the growing edge */
-				if (sync_window(fs) != FR_OK) ABORT(fs, FR_DISK_ERR);
-				fs->winsect = sect;
-			}
-#else
-			if (fp->sect != sect && 		/* Fill sector cache with file data */
-				fp->fptr < fp->obj.objsize &&
-				disk_read(fs->pdrv, fp->buf, sect, 1) != RES_OK) {
-					ABORT(fs, FR_DISK_ERR);
-			}
+		if (fp->fptr >= fp->obj.objsize) {	/* Avoid silly cache filling on the growing edge */
+			if (sync_window(fs) != FR_OK) ABORT(fs, FR_DISK_ERR);
+#if FF_WIN_CACHE
+			inval_cache(fs, sect, 1);
 #endif
-			fp->sect = sect;
+			fs->winsect = sect;
 		}
-		wcnt = SS(fs) - (UINT)fp->fptr % SS(fs);	/* Number of bytes remains in the sector */
-		if (wcnt > btw) wcnt = btw;					/* Clip it by btw if needed */
-#if FF_FS_TINY
-		if (move_window(fs, fp->sect) != FR_OK) ABORT(fs, FR_DISK_ERR);	/* Move sector window */
-		memcpy(fs->win + fp->fptr % SS(fs), wbuff, wcnt);	/* Fit data to the sector */
-		fs->wflag = 1;
+		fp->sect = sect;
 #else
-		memcpy(fp->buf + fp->fptr % SS(fs), wbuff, wcnt);	/* Fit data to the sector */
-		fp->flag |= FA_DIRTY;
+		if (fill_buf(fp, sect, 1) != FR_OK) ABORT(fs, FR_DISK_ERR);	/* Fill sector cache with file data or collect it next to the dirty sectors */
 #endif
 	}
-
+#if FF_FS_TINY
+	if (move_window(fs, fp->sect) != FR_OK) ABORT(fs, FR_DISK_ERR);	/* Move sector window */
+	dbuf = fs->win;
+	fs->wflag = 1;
+#else
+	dbuf = fp->buf + fp->bidx * SS(fs);
+	fp->flag |= FA_DIRTY;
+#endif
+	wcnt = SS(fs) - (UINT)fp->fptr % SS(fs);	/* Number of bytes remains in the sector */
+	if (wcnt > btw) wcnt = btw;					/* Clip it by btw if needed */
+	*buff = dbuf + fp->fptr % SS(fs);			/* Return the buffer to be filled by the application */
+	*bw = wcnt;
+	fp->fptr += wcnt;
+	if (fp->fptr > fp->obj.objsize) fp->obj.objsize = fp->fptr;
 	fp->flag |= FA_MODIFIED;				/* Set file change flag */
 
 	LEAVE_FF(fs, FR_OK);
 }
+#endif
 
 
 
@@ -4148,10 +6377,7 @@ FRESULT f_sync (
 	if (res == FR_OK) {
 		if (fp->flag & FA_MODIFIED) {	/* Is there any change to the file? */
 #if !FF_FS_TINY
-			if (fp->flag & FA_DIRTY) {	/* Write-back cached data if needed */
-				if (disk_write(fs->pdrv, fp->buf, fp->sect, 1) != RES_OK) LEAVE_FF(fs, FR_DISK_ERR);
-				fp->flag &= (BYTE)~FA_DIRTY;
-			}
+			if (flush_buf(fp) != FR_OK) LEAVE_FF(fs, FR_DISK_ERR);	/* Write-back cached data if needed */
 #endif
 			/* Update the directory entry */
 			tm = GET_FATTIME();				/* Modified time */
@@ -4229,6 +6455,9 @@ FRESULT f_close (
 	{
 		res = validate(&fp->obj, &fs);	/* Lock volume */
 		if (res == FR_OK) {
+#if FF_CLST_RESERVE && !FF_FS_READONLY
+			rsv_close(fs, &fp->obj);	/* Release the reservation window */
+#endif
 #if FF_FS_LOCK
 			res = dec_share(fp->obj.lockid);		/* Decrement file open counter */
 			if (res == FR_OK) fp->obj.fs = 0;	/* Invalidate file object */
@@ -4443,10 +6672,13 @@ FRESULT f_lseek (
 	LBA_t nsect;
 	FSIZE_t ifptr;
 #if FF_USE_FASTSEEK
-	DWORD cl, pcl, ncl, tcl, tlen, ulen;
+	DWORD cl, ncl, tlen, ulen;
 	DWORD *tbl;
 	LBA_t dsc;
 #endif
+#if FF_USE_FASTSEEK || FF_FASTSEEK_AUTO
+	DWORD pcl, tcl;
+#endif
 
 	res = validate(&fp->obj, &fs);		/* Check validity of the file object */
 	if (res == FR_OK) res = (FRESULT)fp->err;
@@ -4492,17 +6724,12 @@ FRESULT f_lseek (
 				dsc = clst2sect(fs, fp->clust);
 				if (dsc == 0) ABORT(fs, FR_INT_ERR);
 				dsc += (DWORD)((ofs - 1) / SS(fs)) & (fs->csize - 1);
-				if (fp->fptr % SS(fs) && dsc != fp->sect) {	/* Refill sector cache if needed */
+				if (fp->fptr % SS(fs)) {	/* Refill sector cache if needed */
 #if !FF_FS_TINY
-#if !FF_FS_READONLY
-					if (fp->flag & FA_DIRTY) {		/* Write-back dirty sector cache */
-						if (disk_write(fs->pdrv, fp->buf, fp->sect, 1) != RES_OK) ABORT(fs, FR_DISK_ERR);
-						fp->flag &= (BYTE)~FA_DIRTY;
-					}
-#endif
-					if (disk_read(fs->pdrv, fp->buf, dsc, 1) != RES_OK) ABORT(fs, FR_DISK_ERR);	/* Load current sector */
-#endif
+					if (fill_buf(fp, dsc, 0) != FR_OK) ABORT(fs, FR_DISK_ERR);	/* Load current sector */
+#else
 					fp->sect = dsc;
+#endif
 				}
 			}
 		}
@@ -4539,6 +6766,21 @@ FRESULT f_lseek (
 				fp->clust = clst;
 			}
 			if (clst != 0) {
+#if FF_FASTSEEK_AUTO
+				if (ofs > bcs) {						/* Jump over the clusters with the link map */
+					tcl = (DWORD)((fp->fptr + ofs - 1) / bcs);	/* Cluster order of the destination */
+					res = extend_map(fp, tcl);
+					if (res != FR_OK) ABORT(fs, res);
+					if (tcl >= fp->xcnt) tcl = fp->xcnt - 1;	/* Follow the rest of chain on the FAT if not recorded */
+					pcl = (DWORD)(fp->fptr / bcs);		/* Cluster order of current cluster */
+					if (tcl > pcl) {
+						clst = map_clust(fp, tcl);
+						fp->clust = clst;
+						fp->fptr += (FSIZE_t)(tcl - pcl) * bcs;
+						ofs -= (FSIZE_t)(tcl - pcl) * bcs;
+					}
+				}
+#endif
 				while (ofs > bcs) {						/* Cluster following loop */
 					ofs -= bcs; fp->fptr += bcs;
 #if !FF_FS_READONLY
@@ -4572,17 +6814,12 @@ FRESULT f_lseek (
 			fp->obj.objsize = fp->fptr;
 			fp->flag |= FA_MODIFIED;
 		}
-		if (fp->fptr % SS(fs) && nsect != fp->sect) {	/* Fill sector cache if needed */
+		if (fp->fptr % SS(fs)) {	/* Fill sector cache if needed */
 #if !FF_FS_TINY
-#if !FF_FS_READONLY
-			if (fp->flag & FA_DIRTY) {			/* Write-back dirty sector cache */
-				if (disk_write(fs->pdrv, fp->buf, fp->sect, 1) != RES_OK) ABORT(fs, FR_DISK_ERR);
-				fp->flag &= (BYTE)~FA_DIRTY;
-			}
-#endif
-			if (disk_read(fs->pdrv, fp->buf, nsect, 1) != RES_OK) ABORT(fs, FR_DISK_ERR);	/* Fill sector cache */
-#endif
+			if (fill_buf(fp, nsect, 0) != FR_OK) ABORT(fs, FR_DISK_ERR);	/* Fill sector cache */
+#else
 			fp->sect = nsect;
+#endif
 		}
 	}
 
@@ -4723,6 +6960,106 @@ FRESULT f_readdir (
 
 
 
+
+/*-----------------------------------------------------------------------*/
+/* Read Directory Entries in Batch                                       */
+/*-----------------------------------------------------------------------*/
+
+FRESULT f_readdir_batch (
+	DIR* dp,			/* Pointer to the open directory object */
+	FILINFO* fno,		/* Pointer to the array of file information to return */
+	UINT n,				/* Number of items in the array */
+	UINT* got			/* Pointer to number of items read */
+)
+{
+	FRESULT res;
+	FATFS *fs;
+	UINT cnt;
+	DEF_NAMBUF
+
+
+	*got = cnt = 0;	/* Clear read item count */
+	if (!fno) return FR_INVALID_PARAMETER;
+	res = validate(&dp->obj, &fs);	/* Check validity of the directory object */
+	if (res == FR_OK) {
+		INIT_NAMBUF(fs);
+		for ( ; cnt < n; cnt++) {		/* Repeat until the array gets full or end of directory */
+			res = DIR_READ_FILE(dp);	/* Read an item */
+			if (res != FR_OK) break;
+			get_fileinfo(dp, &fno[cnt]);	/* Get the object information */
+			res = dir_next(dp, 0);		/* Increment index for next */
+			if (res != FR_OK) {
+				if (res == FR_NO_FILE) cnt++;	/* This item is the last one in the directory */
+				break;
+			}
+		}
+		if (res == FR_NO_FILE) res = FR_OK;	/* Ignore end of directory */
+		FREE_NAMBUF();
+	}
+	*got = cnt;
+	LEAVE_FF(fs, res);
+}
+
+
+
+
+/*-----------------------------------------------------------------------*/
+/* Read Directory Entries into Packed Records                            */
+/*-----------------------------------------------------------------------*/
+
+FRESULT f_readdir_pack (
+	DIR* dp,			/* Pointer to the open directory object */
+	void* buff,			/* Pointer to the buffer to store the records (aligned to FSIZE_t) */
+	UINT len,			/* Size of the buffer in unit of byte */
+	UINT* got			/* Pointer to number of records stored */
+)
+{
+	FRESULT res;
+	FATFS *fs;
+	FILINFO fno;
+	FILREC *rec;
+	BYTE *pb = (BYTE*)buff;
+	UINT cnt, nc, sz;
+	DEF_NAMBUF
+
+
+	*got = cnt = 0;	/* Clear stored record count */
+	if (!pb) return FR_INVALID_PARAMETER;
+	res = validate(&dp->obj, &fs);	/* Check validity of the directory object */
+	if (res == FR_OK) {
+		INIT_NAMBUF(fs);
+		for (;;) {
+			res = DIR_READ_FILE(dp);	/* Read an item */
+			if (res != FR_OK) break;
+			get_fileinfo(dp, &fno);		/* Get the object information */
+			for (nc = 0; fno.fname[nc]; nc++) ;	/* Name length */
+			rec = (FILREC*)pb;
+			sz = (UINT)((BYTE*)rec->fname - pb) + (nc + 1) * sizeof (TCHAR);
+			sz = (sz + sizeof (FSIZE_t) - 1) & ~(sizeof (FSIZE_t) - 1);	/* Record size aligned to FSIZE_t */
+			if (sz > len) {				/* The record does not fit in the rest of buffer? */
+				res = FR_OK;
+#if FF_USE_LFN
+				if (dp->blk_ofs != 0xFFFFFFFF) res = dir_sdi(dp, dp->blk_ofs);	/* Go back to top of the entry block to leave the item unread */
+#endif
+				if (res == FR_OK && cnt == 0) res = FR_INVALID_PARAMETER;	/* The buffer is too small to store even an item */
+				break;
+			}
+			rec->fsize = fno.fsize; rec->fdate = fno.fdate; rec->ftime = fno.ftime; rec->fattrib = fno.fattrib;
+			rec->size = (WORD)sz;
+			memcpy(rec->fname, fno.fname, (nc + 1) * sizeof (TCHAR));
+			pb += sz; len -= sz; cnt++;
+			res = dir_next(dp, 0);		/* Increment index for next */
+			if (res != FR_OK) break;
+		}
+		if (res == FR_NO_FILE) res = FR_OK;	/* Ignore end of directory */
+		FREE_NAMBUF();
+	}
+	*got = cnt;
+	LEAVE_FF(fs, res);
+}
+
+
+
 #if FF_USE_FIND
 /*-----------------------------------------------------------------------*/
 /* Find Next File                                                        */
@@ -4815,6 +7152,42 @@ FRESULT f_stat (
 /* Get Number of Free Clusters                                           */
 /*-----------------------------------------------------------------------*/
 
+static UINT count_bits (	/* Number of bits with one */
+	DWORD v		/* 32-bit word to be counted */
+)
+{
+	v -= (v >> 1) & 0x55555555;
+	v = (v & 0x33333333) + ((v >> 2) & 0x33333333);
+	return (UINT)((((v + (v >> 4)) & 0x0F0F0F0F) * 0x01010101) >> 24);
+}
+
+
+static UINT count_free (	/* Number of free entries */
+	FATFS* fs,		/* Filesystem object (FAT16/32) */
+	const BYTE* ptr,	/* Pointer to the FAT entries */
+	UINT n			/* Number of entries to be checked */
+)
+{
+	UINT nf = 0;
+	DWORD v;
+
+
+	if (fs->fs_type == FS_FAT16) {
+		for ( ; n >= 2; n -= 2, ptr += 4) {	/* Check two entries at a time */
+			v = ld_dword(ptr);
+			v = ~(((v & 0x7FFF7FFF) + 0x7FFF7FFF) | v) & 0x80008000;	/* b15/b31 is set if the entry is zero */
+			nf += count_bits(v);
+		}
+		if (n && ld_word(ptr) == 0) nf++;
+	} else {
+		for ( ; n; n--, ptr += 4) {
+			if ((ld_dword(ptr) & 0x0FFFFFFF) == 0) nf++;
+		}
+	}
+	return nf;
+}
+
+
 FRESULT f_getfree (
 	const TCHAR* path,	/* Logical drive number */
 	DWORD* nclst,		/* Pointer to a variable to return number of free clusters */
@@ -4825,8 +7198,12 @@ FRESULT f_getfree (
 	FATFS *fs;
 	DWORD nfree, clst, stat;
 	LBA_t sect;
-	UINT i;
+	UINT i, n;
+	BYTE *fw = 0;
 	FFOBJID obj;
+#if FF_FREE_MAP
+	DWORD nused;
+#endif
 
 
 	/* Get logical drive */
@@ -4839,6 +7216,9 @@ FRESULT f_getfree (
 		} else {
 			/* Scan FAT to obtain number of free clusters */
 			nfree = 0;
+#if FF_FREE_MAP
+			nused = 0;
+#endif
 			if (fs->fs_type == FS_FAT12) {	/* FAT12: Scan bit field FAT entries */
 				clst = 2; obj.fs = fs;
 				do {
@@ -4850,47 +7230,67 @@ FRESULT f_getfree (
 						res = FR_INT_ERR; break;
 					}
 					if (stat == 0) nfree++;
+#if FF_FREE_MAP
+					scan_fmap(fs, clst, 1, stat == 0, &nused);
+#endif
 				} while (++clst < fs->n_fatent);
 			} else {
 #if FF_FS_EXFAT
 				if (fs->fs_type == FS_EXFAT) {	/* exFAT: Scan allocation bitmap */
-					BYTE bm;
-					UINT b;
-
 					clst = fs->n_fatent - 2;	/* Number of clusters */
 					sect = fs->bitbase;			/* Bitmap sector */
 					i = 0;						/* Offset in the sector */
-					do {	/* Counts numbuer of bits with zero in the bitmap */
+					do {	/* Counts numbuer of bits with zero in the bitmap, 32 bits at a time */
 						if (i == 0) {	/* New sector? */
-							res = move_window(fs, sect++);
-							if (res != FR_OK) break;
+#if FF_FAT_CACHE > 1 || FF_READAHEAD
+							prefetch_fat(fs, sect);
+#endif
+							fw = fat_window(fs, sect++, 0);
+							if (!fw) {
+								res = FR_DISK_ERR; break;
+							}
 						}
-						for (b = 8, bm = ~fs->win[i]; b && clst; b--, clst--) {
-							nfree += bm & 1;
-							bm >>= 1;
+						stat = ~ld_dword(fw + i);	/* Zero bits in the next 32 bits */
+						if (clst < 32) {			/* Mask out the bits over the last cluster */
+							stat &= ((DWORD)1 << clst) - 1;
+							n = clst;
+						} else {
+							n = 32;
 						}
-						i = (i + 1) % SS(fs);
+						nfree += count_bits(stat);
+						clst -= n;
+						i = (i + 4) % SS(fs);
 					} while (clst);
 				} else
 #endif
 				{	/* FAT16/32: Scan WORD/DWORD FAT entries */
-					clst = fs->n_fatent;	/* Number of entries */
+					clst = 0;				/* Cluster number of the entry */
 					sect = fs->fatbase;		/* Top of the FAT */
-					i = 0;					/* Offset in the sector */
-					do {	/* Counts numbuer of entries with zero in the FAT */
-						if (i == 0) {	/* New sector? */
-							res = move_window(fs, sect++);
-							if (res != FR_OK) break;
-						}
-						if (fs->fs_type == FS_FAT16) {
-							if (ld_word(fs->win + i) == 0) nfree++;
-							i += 2;
-						} else {
-							if ((ld_dword(fs->win + i) & 0x0FFFFFFF) == 0) nfree++;
-							i += 4;
+					do {	/* Counts numbuer of entries with zero in each sector of the FAT */
+#if FF_FAT_CACHE > 1 || FF_READAHEAD
+						prefetch_fat(fs, sect);
+#endif
+						fw = fat_window(fs, sect++, 0);
+						if (!fw) {
+							res = FR_DISK_ERR; break;
 						}
-						i %= SS(fs);
-					} while (--clst);
+						i = 0;				/* Offset in the sector */
+						do {
+							n = (SS(fs) - i) / (fs->fs_type == FS_FAT16 ? 2 : 4);	/* Number of entries to be checked */
+							if (n > fs->n_fatent - clst) n = fs->n_fatent - clst;
+#if FF_FREE_MAP
+							stat = (((clst >> fs->fmshift) + 1) << fs->fmshift) - clst;	/* Do not go across the group boundary */
+							if (n > stat) n = stat;
+#endif
+							stat = count_free(fs, fw + i, n);
+							nfree += stat;
+#if FF_FREE_MAP
+							scan_fmap(fs, clst + n - 1, n, stat, &nused);
+#endif
+							clst += n;
+							i += n * (fs->fs_type == FS_FAT16 ? 2 : 4);
+						} while (i < SS(fs) && clst < fs->n_fatent);
+					} while (clst < fs->n_fatent);
 				}
 			}
 			if (res == FR_OK) {		/* Update parameters if succeeded */
@@ -4939,13 +7339,22 @@ FRESULT f_truncate (
 		}
 		fp->obj.objsize = fp->fptr;	/* Set file size to current read/write point */
 		fp->flag |= FA_MODIFIED;
+#if FF_FASTSEEK_AUTO
+		ncl = (DWORD)((fp->fptr + (DWORD)fs->csize * SS(fs) - 1) / ((DWORD)fs->csize * SS(fs)));	/* Number of clusters left */
+		if (fp->xcnt > ncl) fp->xcnt = ncl;	/* Trim the link map */
+		while (fp->xfrag > 0 && fp->xofs[fp->xfrag - 1] >= fp->xcnt) fp->xfrag--;
+		fp->xfull = 0;
+#endif
 #if !FF_FS_TINY
-		if (res == FR_OK && (fp->flag & FA_DIRTY)) {
-			if (disk_write(fs->pdrv, fp->buf, fp->sect, 1) != RES_OK) {
-				res = FR_DISK_ERR;
+		if (res == FR_OK) res = flush_buf(fp);
+		if (res == FR_OK && fp->bcnt > 1) {	/* Leave only the current sector in the window, others can be out of the file */
+			if (fp->fptr % SS(fs)) {
+				memmove(fp->buf, fp->buf + fp->bidx * SS(fs), SS(fs));
+				fp->sect += fp->bidx; fp->bcnt = 1;
 			} else {
-				fp->flag &= (BYTE)~FA_DIRTY;
+				fp->bcnt = 0;
 			}
+			fp->bidx = 0;
 		}
 #endif
 		if (res != FR_OK) ABORT(fs, res);
@@ -5033,6 +7442,18 @@ FRESULT f_unlink (
 			if (res == FR_OK) {
 				res = dir_remove(&dj);			/* Remove the directory entry */
 				if (res == FR_OK && dclst != 0) {	/* Remove the cluster chain if exist */
+#if FF_DIR_INDEX
+					if (fs->dxclst == dclst) fs->dxstat = 0;	/* Discard the name index of the removed directory */
+#endif
+#if FF_PATH_CACHE
+					del_pcache(fs, dclst, 0xFFFFFFFF);	/* Discard the names not found in the removed directory */
+#endif
+#if FF_SFN_FILTER && FF_USE_LFN
+					if (fs->nfclst == dclst) fs->nfstat = 0;	/* Discard the SFN filter of the removed directory */
+#endif
+#if FF_DIR_HINT
+					put_dhint(fs, dclst, 0);	/* Discard the hint of the removed directory */
+#endif
 #if FF_FS_EXFAT
 					res = remove_chain(&obj, dclst, 0);
 #else
@@ -5524,6 +7945,9 @@ FRESULT f_setlabel (
 					memcpy(dj.dir, dirvn, 11);	/* Change the volume label */
 				} else {
 					dj.dir[DIR_Name] = DDEM;	/* Remove the volume label */
+#if FF_DIR_HINT
+					put_dhint(fs, 0, dj.dptr);
+#endif
 				}
 			}
 			fs->wflag = 1;
@@ -5572,7 +7996,10 @@ FRESULT f_expand (
 {
 	FRESULT res;
 	FATFS *fs;
-	DWORD n, clst, stcl, scl, ncl, tcl, lclst;
+	DWORD n, clst, scl, tcl, lclst;
+#if !FF_FREE_EXTENT
+	DWORD stcl, ncl;
+#endif
 
 
 	res = validate(&fp->obj, &fs);		/* Check validity of the file object */
@@ -5583,12 +8010,20 @@ FRESULT f_expand (
 #endif
 	n = (DWORD)fs->csize * SS(fs);	/* Cluster size */
 	tcl = (DWORD)(fsz / n) + ((fsz & (n - 1)) ? 1 : 0);	/* Number of clusters required */
-	stcl = fs->last_clst; lclst = 0;
+	lclst = 0;
+#if !FF_FREE_EXTENT
+	stcl = fs->last_clst;
 	if (stcl < 2 || stcl >= fs->n_fatent) stcl = 2;
+#endif
 
 #if FF_FS_EXFAT
 	if (fs->fs_type == FS_EXFAT) {
+#if FF_FREE_EXTENT
+		scl = find_extent(&fp->obj, tcl);			/* Find the best fit cluster block in the free extent index */
+		if (scl == 1) res = FR_INT_ERR;
+#else
 		scl = find_bitmap(fs, stcl, tcl);			/* Find a contiguous cluster block */
+#endif
 		if (scl == 0) res = FR_DENIED;				/* No contiguous cluster block was found */
 		if (scl == 0xFFFFFFFF) res = FR_DISK_ERR;
 		if (res == FR_OK) {	/* A contiguous free area is found */
@@ -5602,6 +8037,12 @@ FRESULT f_expand (
 	} else
 #endif
 	{
+#if FF_FREE_EXTENT
+		scl = find_extent(&fp->obj, tcl);	/* Find the best fit cluster block in the free extent index */
+		if (scl == 0) res = FR_DENIED;
+		if (scl == 1) res = FR_INT_ERR;
+		if (scl == 0xFFFFFFFF) res = FR_DISK_ERR;
+#else
 		scl = clst = stcl; ncl = 0;
 		for (;;) {	/* Find a contiguous cluster block */
 			n = get_fat(&fp->obj, clst);
@@ -5621,6 +8062,7 @@ FRESULT f_expand (
 				res = FR_DENIED; break;
 			}
 		}
+#endif
 		if (res == FR_OK) {	/* A contiguous free area is found */
 			if (opt) {		/* Allocate it now */
 				for (clst = scl, n = tcl; n; clst++, n--) {	/* Create a cluster chain on the FAT */
@@ -5701,19 +8143,123 @@ FRESULT f_forward (
 #if FF_FS_TINY
 		if (move_window(fs, sect) != FR_OK) ABORT(fs, FR_DISK_ERR);	/* Move sector window to the file data */
 		dbuf = fs->win;
+		fp->sect = sect;
 #else
-		if (fp->sect != sect) {		/* Fill sector cache with file data */
-#if !FF_FS_READONLY
-			if (fp->flag & FA_DIRTY) {		/* Write-back dirty sector cache */
-				if (disk_write(fs->pdrv, fp->buf, fp->sect, 1) != RES_OK) ABORT(fs, FR_DISK_ERR);
-				fp->flag &= (BYTE)~FA_DIRTY;
-			}
+		if (fill_buf(fp, sect, 0) != FR_OK) ABORT(fs, FR_DISK_ERR);	/* Fill sector cache with file data */
+		dbuf = fp->buf + fp->bidx * SS(fs);
+#endif
+		rcnt = SS(fs) - (UINT)fp->fptr % SS(fs);	/* Number of bytes remains in the sector */
+		if (rcnt > btf) rcnt = btf;					/* Clip it by btr if needed */
+		rcnt = (*func)(dbuf + ((UINT)fp->fptr % SS(fs)), rcnt);	/* Forward the file data */
+		if (rcnt == 0) ABORT(fs, FR_INT_ERR);
+	}
+
+	LEAVE_FF(fs, FR_OK);
+}
+
+
+#if FF_USE_FORWARD >= 2
+FRESULT f_forward_ex (
+	FIL* fp, 						/* Pointer to the file object */
+	UINT (*func)(const BYTE*,UINT),	/* Pointer to the streaming function */
+	BYTE* rbuf,						/* Pointer to the ring buffer to read the sectors into */
+	UINT rsize,						/* Size of the ring buffer [byte] (>=sector size) */
+	UINT* rpos,						/* Pointer to the write position in the ring buffer (kept by the caller) */
+	UINT btf,						/* Number of bytes to forward */
+	UINT* bf						/* Pointer to number of bytes forwarded */
+)
+{
+	FRESULT res;
+	FATFS *fs;
+	DWORD clst, sclst;
+	LBA_t sect;
+	FSIZE_t remain, sfptr;
+	UINT rcnt, cc, csect, n, acc;
+	BYTE *dbuf;
+
+
+	*bf = 0;	/* Clear transfer byte counter */
+	res = validate(&fp->obj, &fs);		/* Check validity of the file object */
+	if (res != FR_OK || (res = (FRESULT)fp->err) != FR_OK) LEAVE_FF(fs, res);
+	if (!(fp->flag & FA_READ)) LEAVE_FF(fs, FR_DENIED);	/* Check access mode */
+	if (!rbuf || rsize < SS(fs)) LEAVE_FF(fs, FR_INVALID_PARAMETER);
+
+	remain = fp->obj.objsize - fp->fptr;
+	if (btf > remain) btf = (UINT)remain;			/* Truncate btf by remaining bytes */
+
+	for ( ; btf > 0 && (*func)(0, 0); fp->fptr += rcnt, *bf += rcnt, btf -= rcnt) {	/* Repeat until all data transferred or stream goes busy */
+		csect = (UINT)(fp->fptr / SS(fs) & (fs->csize - 1));	/* Sector offset in the cluster */
+		if (fp->fptr % SS(fs) == 0) {				/* On the sector boundary? */
+			if (csect == 0) {						/* On the cluster boundary? */
+				if (fp->fptr == 0) {				/* On the top of the file? */
+					clst = fp->obj.sclust;			/* Follow cluster chain from the origin */
+				} else {							/* Middle or end of the file */
+#if FF_USE_FASTSEEK
+					if (fp->cltbl) {
+						clst = clmt_clust(fp, fp->fptr);	/* Get cluster# from the CLMT */
+					} else
 #endif
-			if (disk_read(fs->pdrv, fp->buf, sect, 1) != RES_OK) ABORT(fs, FR_DISK_ERR);
+#if FF_FASTSEEK_AUTO
+					if (fp->fptr / SS(fs) / fs->csize < fp->xcnt) {
+						clst = map_clust(fp, (DWORD)(fp->fptr / SS(fs) / fs->csize));	/* Get cluster# from the link map */
+					} else
+#endif
+					{
+						clst = get_fat(&fp->obj, fp->clust);	/* Follow cluster chain on the FAT */
+					}
+				}
+				if (clst <= 1) ABORT(fs, FR_INT_ERR);
+				if (clst == 0xFFFFFFFF) ABORT(fs, FR_DISK_ERR);
+				fp->clust = clst;					/* Update current cluster */
+			}
 		}
-		dbuf = fp->buf;
+		sect = clst2sect(fs, fp->clust);			/* Get current data sector */
+		if (sect == 0) ABORT(fs, FR_INT_ERR);
+		sect += csect;
+		cc = btf / SS(fs);							/* Number of whole sectors to forward */
+		if (fp->fptr % SS(fs) == 0 && cc > 0) {		/* Read maximum contiguous sectors into the ring buffer */
+			if (*rpos > rsize || rsize - *rpos < SS(fs)) *rpos = 0;	/* Wrap-around the ring buffer if no sector fits the rest */
+			n = (rsize - *rpos) / SS(fs);
+			if (cc > n) cc = n;						/* Clip at end of the ring buffer */
+			sclst = fp->clust; sfptr = fp->fptr;	/* Top of the run */
+			if (csect + cc > fs->csize) {			/* Clip at cluster boundary */
+				n = cc; cc = fs->csize - csect;
+				while (cc < n) {					/* Extend it over the following clusters while they are contiguous */
+#if FF_USE_FASTSEEK
+					if (fp->cltbl) {
+						clst = clmt_clust(fp, fp->fptr + (FSIZE_t)cc * SS(fs));	/* Get cluster# from the CLMT */
+					} else
 #endif
+					{
+						clst = get_fat(&fp->obj, fp->clust);	/* Follow cluster chain on the FAT */
+					}
+					if (clst != fp->clust + 1 || clst >= fs->n_fatent) break;	/* Not contiguous? (errors are checked at next cluster boundary) */
+					fp->clust = clst;
+					cc += fs->csize;
+				}
+				if (cc > n) cc = n;
+			}
+			dbuf = rbuf + *rpos;
+			if (disk_read(fs->pdrv, dbuf, sect, cc) != RES_OK) ABORT(fs, FR_DISK_ERR);
+#if !FF_FS_READONLY && FF_FS_MINIMIZE <= 2
+			merge_dirty(fp, sect, dbuf, cc);	/* Replace the read sectors with cached data if it contains a dirty sector */
+#endif
+			*rpos += SS(fs) * cc;					/* Advance the ring buffer */
+			for (rcnt = 0; rcnt < SS(fs) * cc && (rcnt == 0 || (*func)(0, 0)); rcnt += acc) {	/* Forward the run while the stream accepts it */
+				acc = (*func)(dbuf + rcnt, SS(fs) * cc - rcnt);
+				if (acc == 0) ABORT(fs, FR_INT_ERR);
+			}
+			fp->clust = sclst + (DWORD)((sfptr + rcnt - 1) / SS(fs) / fs->csize - sfptr / SS(fs) / fs->csize);	/* Cluster at the forwarded position in the contiguous run */
+			continue;
+		}
+#if FF_FS_TINY
+		if (move_window(fs, sect) != FR_OK) ABORT(fs, FR_DISK_ERR);	/* Move sector window to the file data */
+		dbuf = fs->win;
 		fp->sect = sect;
+#else
+		if (fill_buf(fp, sect, 0) != FR_OK) ABORT(fs, FR_DISK_ERR);	/* Fill sector cache with file data */
+		dbuf = fp->buf + fp->bidx * SS(fs);
+#endif
 		rcnt = SS(fs) - (UINT)fp->fptr % SS(fs);	/* Number of bytes remains in the sector */
 		if (rcnt > btf) rcnt = btf;					/* Clip it by btr if needed */
 		rcnt = (*func)(dbuf + ((UINT)fp->fptr % SS(fs)), rcnt);	/* Forward the file data */
@@ -5722,6 +8268,7 @@ FRESULT f_forward (
 
 	LEAVE_FF(fs, FR_OK);
 }
+#endif
 #endif /* FF_USE_FORWARD */
 
 
@@ -7070,7 +9617,7 @@ FRESULT f_setcp (
 
 
 	for (i = 0; validcp[i] != 0 && validcp[i] != cp; i++) ;	/* Find the code page */
-	if (validcp[i] != cp) return FR_INVALID_PARAMETER;		/* Not found? */
+	if (validcp[i] != cp || (cp != 0 && !(((DWORD)FF_CODE_PAGE_SET >> i) & 1))) return FR_INVALID_PARAMETER;	/* Not found or not included? */
 
 	CodePage = cp;
 	if (cp >= 900) {	/* DBCS */
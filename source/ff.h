@@ -31,6 +31,12 @@ extern "C" {
 #if FF_DEFINED != FFCONF_DEF
 #error Wrong configuration file (ffconf.h).
 #endif
+#ifndef FF_CODE_PAGE_SET
+#define FF_CODE_PAGE_SET	0x1FFFFF	/* Default code page set for the configuration files without this option (all code pages) */
+#endif
+#ifndef FF_FIL_BUF
+#define FF_FIL_BUF	1		/* Default size of the file data buffer for the configuration files without this option */
+#endif
 
 
 /* Integer types used for FatFs API */
@@ -148,6 +154,9 @@ typedef struct {
 #if FF_FS_EXFAT
 	BYTE*	dirbuf;			/* Directory entry block scratchpad buffer for exFAT */
 #endif
+#if FF_USE_ASYNC
+	volatile BYTE	abusy;	/* Asynchronous transfer in progress (1:the volume is locked out until completion) */
+#endif
 #if !FF_FS_READONLY
 	DWORD	last_clst;		/* Last allocated cluster */
 	DWORD	free_clst;		/* Number of free clusters */
@@ -171,6 +180,84 @@ typedef struct {
 #endif
 	LBA_t	winsect;		/* Current sector appearing in the win[] */
 	BYTE	win[FF_MAX_SS];	/* Disk access window for Directory, FAT (and file data at tiny cfg) */
+#if FF_WIN_CACHE || FF_FAT_CACHE
+	DWORD	ctick;			/* Access counter of the window/FAT cache */
+#endif
+#if FF_WIN_CACHE
+	DWORD	cage[FF_WIN_CACHE];	/* Last access count of each cache slot */
+	LBA_t	csect[FF_WIN_CACHE];	/* Sector held in each cache slot ((LBA_t)0-1:blank) */
+	BYTE	cflag[FF_WIN_CACHE];	/* Status of each cache slot (b0:dirty) */
+	BYTE	cbuf[FF_WIN_CACHE][FF_MAX_SS];	/* Window cache buffers */
+#endif
+#if FF_LAZY_FAT2 && !FF_FS_READONLY
+	UINT	n_mirror;		/* Number of FAT sectors pending to be reflected to the 2nd FAT */
+	DWORD	mirror[FF_LAZY_FAT2];	/* Offsets of the pending FAT sectors in ascending order */
+#endif
+#if FF_FAT_CACHE
+	DWORD	fage[FF_FAT_CACHE];	/* Last access count of each FAT cache slot */
+	LBA_t	fsect[FF_FAT_CACHE];	/* FAT/bitmap sector held in each FAT cache slot ((LBA_t)0-1:blank) */
+	BYTE	fflag[FF_FAT_CACHE];	/* Status of each FAT cache slot (b0:dirty) */
+	BYTE	fbuf[FF_FAT_CACHE][FF_MAX_SS];	/* FAT cache buffers */
+#endif
+#if FF_FREE_MAP && !FF_FS_READONLY
+	BYTE	fmshift;		/* Size of the cluster group in the free space map (log2) */
+	DWORD	fmap[FF_FREE_MAP / 4];	/* Free space map (1:can have free cluster, 0:no free cluster) */
+#endif
+#if FF_CLST_RESERVE && !FF_FS_READONLY
+	const void*	rvobj[FF_CLST_RSV_FILES];	/* Owner file of each cluster reservation window (0:blank) */
+	DWORD	rvtop[FF_CLST_RSV_FILES];	/* Next cluster to be allocated in each window */
+	DWORD	rvend[FF_CLST_RSV_FILES];	/* End of each window */
+	UINT	rvidx;			/* Entry to be replaced when the table is full */
+#endif
+#if FF_FREE_EXTENT && FF_USE_EXPAND && !FF_FS_READONLY
+	BYTE	fxflag;			/* Status of the free extent index (b0:the longest blocks are held) */
+	DWORD	fxmax;			/* Length of the longest free block out of the index (valid if fxflag.0) */
+	DWORD	fxscl[FF_FREE_EXTENT];	/* Top cluster of each free block in the index */
+	DWORD	fxncl[FF_FREE_EXTENT];	/* Number of clusters of each free block in the index (0:blank) */
+#endif
+#if FF_DIR_INDEX
+	BYTE	dxstat;			/* Status of the directory name index (0:blank, 1:valid, 2:too many objects) */
+	DWORD	dxclst;			/* Start cluster of the indexed directory (0:root directory) */
+	UINT	dxcnt;			/* Number of objects in the index */
+	DWORD	dxcand;			/* Start cluster of the directory to be indexed next (0:root directory) */
+	BYTE	dxmiss;			/* Number of long searches in dxcand since the index was last used */
+#if FF_USE_LFN
+	WORD	dxtop[FF_DIR_INDEX];	/* Top entry of each object (LFN entry or SFN entry) */
+	WORD	dxlh[FF_DIR_INDEX];	/* Hash value of the up-cased LFN of each object */
+#endif
+	WORD	dxsfn[FF_DIR_INDEX];	/* SFN entry of each object */
+	WORD	dxsh[FF_DIR_INDEX];	/* Hash value of the SFN of each object */
+#endif
+#if FF_PATH_CACHE
+	DWORD	pctick;			/* Access counter of the path cache */
+	DWORD	pcage[FF_PATH_CACHE];	/* Last access count of each path cache entry */
+	DWORD	pcdir[FF_PATH_CACHE];	/* Start cluster of the directory containing the object (0:root directory) */
+	DWORD	pcofs[FF_PATH_CACHE];	/* Offset of the SFN entry of the object (0xFFFFFFFF:the object does not exist) */
+	DWORD	pcclst[FF_PATH_CACHE];	/* Start cluster of the object */
+	BYTE	pcattr[FF_PATH_CACHE];	/* Attribute of the object */
+#if FF_USE_LFN
+	DWORD	pcblk[FF_PATH_CACHE];	/* Offset of the entry block of the object */
+	WCHAR	pcname[FF_PATH_CACHE][16];	/* Up-cased segment name (pcname[][0] == 0:blank) */
+#else
+	BYTE	pcname[FF_PATH_CACHE][11];	/* SFN of the segment name (pcname[][0] == 0:blank) */
+#endif
+#endif
+#if FF_SFN_FILTER && FF_USE_LFN && !FF_FS_READONLY
+	BYTE	nfstat;			/* Status of the SFN filter (0:blank, 1:valid) */
+	DWORD	nfclst;			/* Start cluster of the directory of the SFN filter (0:root directory) */
+	BYTE	nfbits[FF_SFN_FILTER];	/* SFN filter (bloom filter of the SFNs in the directory) */
+#endif
+#if FF_DIR_HINT && !FF_FS_READONLY
+	BYTE	dhnext;			/* Hint slot to be replaced next */
+	DWORD	dhclst[FF_DIR_HINT];	/* Start cluster of the directory of each hint (0:root directory) */
+	DWORD	dhofs[FF_DIR_HINT];	/* Offset of the directory entry where free entry search starts */
+#endif
+#if FF_READAHEAD
+	LBA_t	rasect;			/* Top sector held in the read-ahead buffer */
+	UINT	racnt;			/* Number of sectors held in the read-ahead buffer (0:empty) */
+	BYTE	rahit;			/* The read-ahead buffer has been hit since the last refill held off */
+	BYTE	rabuf[FF_READAHEAD * FF_MAX_SS];	/* Read-ahead buffer */
+#endif
 } FATFS;
 
 
@@ -206,7 +293,7 @@ typedef struct {
 	BYTE	err;			/* Abort flag (error code) */
 	FSIZE_t	fptr;			/* File read/write pointer (Zeroed on file open) */
 	DWORD	clust;			/* Current cluster of fpter (invalid when fptr is 0) */
-	LBA_t	sect;			/* Sector number appearing in buf[] (0:invalid) */
+	LBA_t	sect;			/* Sector number appearing in buf[] (top of the buffered sectors, 0:invalid) */
 #if !FF_FS_READONLY
 	LBA_t	dir_sect;		/* Sector number containing the directory entry (not used at exFAT) */
 	BYTE*	dir_ptr;		/* Pointer to the directory entry in the win[] (not used at exFAT) */
@@ -214,8 +301,22 @@ typedef struct {
 #if FF_USE_FASTSEEK
 	DWORD*	cltbl;			/* Pointer to the cluster link map table (nulled on open, set by application) */
 #endif
+#if FF_FASTSEEK_AUTO
+	DWORD	xcnt;			/* Number of clusters recorded in the automatic link map */
+	UINT	xfrag;			/* Number of fragments in the automatic link map */
+	BYTE	xfull;			/* The automatic link map has no room for the next fragment */
+	DWORD	xofs[FF_FASTSEEK_AUTO];	/* Cluster order of top of each fragment */
+	DWORD	xclst[FF_FASTSEEK_AUTO];	/* Top cluster of each fragment */
+#endif
+#if FF_READAHEAD
+	LBA_t	ranext;			/* Sector expected to be read next by sequential access */
+#endif
 #if !FF_FS_TINY
-	BYTE	buf[FF_MAX_SS];	/* File private data read/write window */
+	BYTE*	buf;			/* Pointer to the file private data read/write window (ibuf[] or given by f_open_ex) */
+	UINT	bmax;			/* Size of the data window in unit of sector */
+	UINT	bcnt;			/* Number of sectors appearing in buf[] */
+	UINT	bidx;			/* Index of the current sector in buf[] */
+	BYTE	ibuf[FF_FIL_BUF * FF_MAX_SS];	/* Built-in data window */
 #endif
 } FIL;
 
@@ -257,6 +358,19 @@ typedef struct {
 
 
 
+/* Packed file record (FILREC) */
+
+typedef struct {
+	FSIZE_t	fsize;			/* File size */
+	WORD	fdate;			/* Modified date */
+	WORD	ftime;			/* Modified time */
+	BYTE	fattrib;		/* File attribute */
+	WORD	size;			/* Size of this record in unit of byte (offset to the next record) */
+	TCHAR	fname[1];		/* Primary file name (null-terminated, variable length) */
+} FILREC;
+
+
+
 /* Format parameter structure (MKFS_PARM) */
 
 typedef struct {
@@ -296,21 +410,40 @@ typedef enum {
 
 
 
+/* Asynchronous read/write request (FF_AREQ) */
+
+typedef struct {
+	void	(*func)(void* arg, FRESULT res);	/* Completion function (NULL:not used, poll done instead) */
+	void*	arg;			/* Argument passed to the completion function */
+	FIL*	fp;				/* File object of the transfer (set by FatFs) */
+	UINT	nb;				/* Number of bytes transferred by the request (set by FatFs) */
+	FRESULT	res;			/* Result of the transfer (valid after completion) */
+	volatile BYTE	done;	/* Completion flag (0:in progress, 1:completed) */
+} FF_AREQ;
+
+
 
 /*--------------------------------------------------------------*/
 /* FatFs Module Application Interface                           */
 /*--------------------------------------------------------------*/
 
 FRESULT f_open (FIL* fp, const TCHAR* path, BYTE mode);				/* Open or create a file */
+FRESULT f_open_ex (FIL* fp, const TCHAR* path, BYTE mode, void* buff, UINT len);	/* Open or create a file with a data buffer */
 FRESULT f_close (FIL* fp);											/* Close an open file object */
 FRESULT f_read (FIL* fp, void* buff, UINT btr, UINT* br);			/* Read data from the file */
 FRESULT f_write (FIL* fp, const void* buff, UINT btw, UINT* bw);	/* Write data to the file */
+FRESULT f_read_async (FIL* fp, void* buff, UINT btr, FF_AREQ* req);	/* Start to read data from the file */
+FRESULT f_write_async (FIL* fp, const void* buff, UINT btw, FF_AREQ* req);	/* Start to write data to the file */
+FRESULT f_read_map (FIL* fp, const void** buff, UINT btr, UINT* br);	/* Get the pointer to the file data in the sector buffer */
+FRESULT f_write_claim (FIL* fp, void** buff, UINT btw, UINT* bw);	/* Get the pointer to the sector buffer to store the data to be written */
 FRESULT f_lseek (FIL* fp, FSIZE_t ofs);								/* Move file pointer of the file object */
 FRESULT f_truncate (FIL* fp);										/* Truncate the file */
 FRESULT f_sync (FIL* fp);											/* Flush cached data of the writing file */
 FRESULT f_opendir (DIR* dp, const TCHAR* path);						/* Open a directory */
 FRESULT f_closedir (DIR* dp);										/* Close an open directory */
 FRESULT f_readdir (DIR* dp, FILINFO* fno);							/* Read a directory item */
+FRESULT f_readdir_batch (DIR* dp, FILINFO* fno, UINT n, UINT* got);	/* Read directory items in batch */
+FRESULT f_readdir_pack (DIR* dp, void* buff, UINT len, UINT* got);	/* Read directory items into packed records */
 FRESULT f_findfirst (DIR* dp, FILINFO* fno, const TCHAR* path, const TCHAR* pattern);	/* Find first file */
 FRESULT f_findnext (DIR* dp, FILINFO* fno);							/* Find next file */
 FRESULT f_mkdir (const TCHAR* path);								/* Create a sub directory */
@@ -326,6 +459,7 @@ FRESULT f_getfree (const TCHAR* path, DWORD* nclst, FATFS** fatfs);	/* Get numbe
 FRESULT f_getlabel (const TCHAR* path, TCHAR* label, DWORD* vsn);	/* Get volume label */
 FRESULT f_setlabel (const TCHAR* label);							/* Set volume label */
 FRESULT f_forward (FIL* fp, UINT(*func)(const BYTE*,UINT), UINT btf, UINT* bf);	/* Forward data to the stream */
+FRESULT f_forward_ex (FIL* fp, UINT(*func)(const BYTE*,UINT), BYTE* rbuf, UINT rsize, UINT* rpos, UINT btf, UINT* bf);	/* Forward data to the stream in multi-sector runs */
 FRESULT f_expand (FIL* fp, FSIZE_t fsz, BYTE opt);					/* Allocate a contiguous block to the file */
 FRESULT f_mount (FATFS* fs, const TCHAR* path, BYTE opt);			/* Mount/Unmount a logical drive */
 FRESULT f_mkfs (const TCHAR* path, const MKFS_PARM* opt, void* work, UINT len);	/* Create a FAT volume */
@@ -344,6 +478,7 @@ TCHAR* f_gets (TCHAR* buff, int len, FIL* fp);						/* Get a string from the fil
 #define f_size(fp) ((fp)->obj.objsize)
 #define f_rewind(fp) f_lseek((fp), 0)
 #define f_rewinddir(dp) f_readdir((dp), 0)
+#define f_nextrec(rec) ((FILREC*)((BYTE*)(rec) + (rec)->size))
 #define f_rmdir(path) f_unlink(path)
 #define f_unmount(path) f_mount(0, path, 0)
 
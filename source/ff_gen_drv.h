@@ -42,6 +42,14 @@ typedef struct
   DRESULT (*disk_read)       (BYTE, BYTE*, DWORD, UINT);       /*!< Read Sector(s)*/
   DRESULT (*disk_write)      (BYTE, const BYTE*, DWORD, UINT); /*!< Write Sector(s)*/
   DRESULT (*disk_ioctl)      (BYTE, BYTE, void*);              /*!< I/O control operation*/
+#if FF_USE_ASYNC
+  DRESULT (*disk_read_async) (BYTE, BYTE*, DWORD, UINT, DCPLT, void*);       /*!< Start to Read Sector(s), optional (NULL: not supported)*/
+  DRESULT (*disk_write_async)(BYTE, const BYTE*, DWORD, UINT, DCPLT, void*); /*!< Start to Write Sector(s), optional (NULL: not supported)*/
+#endif
+#if FF_DISK_VEC
+  DRESULT (*disk_readv)      (BYTE, const DSEG*, UINT);        /*!< Read Sector(s) into scattered buffers, optional (NULL: not supported)*/
+  DRESULT (*disk_writev)     (BYTE, const DSEG*, UINT);        /*!< Write Sector(s) from scattered buffers, optional (NULL: not supported)*/
+#endif
 }Diskio_drvTypeDef;
 
 /**
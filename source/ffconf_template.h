@@ -21,7 +21,8 @@
 /   0: Basic functions are fully enabled.
 /   1: f_stat(), f_getfree(), f_unlink(), f_mkdir(), f_truncate() and f_rename()
 /      are removed.
-/   2: f_opendir(), f_readdir() and f_closedir() are removed in addition to 1.
+/   2: f_opendir(), f_readdir(), f_readdir_batch(), f_readdir_pack() and f_closedir()
+/      are removed in addition to 1.
 /   3: f_lseek() function is removed in addition to 2. */
 
 
@@ -38,6 +39,16 @@
 /* This option switches fast seek function. (0:Disable or 1:Enable) */
 
 
+#define FF_FASTSEEK_AUTO	0
+/* This option defines the number of fragments held in the automatic cluster link
+/  map in each file object (FIL). (0:Disable or >0) When enabled, the cluster chain
+/  of the file is recorded in the map while f_lseek() follows it, and f_lseek() and
+/  f_read() look up the cluster in the map with binary search instead of following
+/  the chain from the top of the file. The application does not need to prepare
+/  the table. Fragments over the map size are followed on the FAT as usual. Every
+/  fragment adds 8 bytes to the size of the file object. */
+
+
 #define FF_USE_EXPAND	0
 /* This option switches f_expand function. (0:Disable or 1:Enable) */
 
@@ -53,7 +64,22 @@
 
 
 #define FF_USE_FORWARD	0
-/* This option switches f_forward() function. (0:Disable or 1:Enable) */
+/* This option switches f_forward() function. (0:Disable, 1:Enable or 2:Enable with
+/  f_forward_ex() which forwards the contiguous sectors in a run via a ring buffer) */
+
+
+#define FF_USE_ASYNC	0
+/* This option switches asynchronous read/write functions, f_read_async() and
+/  f_write_async(). (0:Disable or 1:Enable) The whole sectors at the file pointer
+/  are handed to disk_read_async()/disk_write_async() of the disk I/O layer and
+/  the functions return without waiting for the transfer. Accesses to the volume
+/  are rejected with FR_LOCKED until the transfer completes. */
+
+
+#define FF_USE_MAP		0
+/* This option switches zero-copy access functions, f_read_map() and f_write_claim().
+/  (0:Disable or 1:Enable) They return a pointer to the file data in the sector
+/  buffer instead of copying it from/to the application buffer. */
 
 
 #define FF_USE_STRFUNC	0
@@ -113,6 +139,42 @@
 */
 
 
+#define FF_CODE_PAGE_SET	0x1FFFFF
+/* This option selects the code pages to be included when FF_CODE_PAGE == 0.
+/  Each bit corresponds to a code page as follows and f_setcp() accepts only the
+/  code pages included. e.g. 0x20021 includes 437, 850 and 932.
+/
+/   bit0: 437, bit1: 720, bit2: 737, bit3: 771, bit4: 775, bit5: 850, bit6: 852,
+/   bit7: 855, bit8: 857, bit9: 860, bit10: 861, bit11: 862, bit12: 863, bit13: 864,
+/   bit14: 865, bit15: 866, bit16: 869, bit17: 932, bit18: 936, bit19: 949, bit20: 950
+*/
+
+
+#define FF_DBCS_DIRECT	0
+/* This option switches the format of the conversion tables for DBCS code pages
+/  to be used when LFN is enabled. Each bit corresponds to a code page.
+/
+/   bit0=1: Two-level direct-index tables are used for CP932 instead of the pair tables.
+/   bit1=1: Two-level direct-index tables are used for CP936 instead of the pair tables.
+/   bit2=1: Two-level direct-index tables are used for CP949 instead of the pair tables.
+/   bit3=1: Two-level direct-index tables are used for CP950 instead of the pair tables.
+/
+/  The code conversion with the pair tables needs a binary search for every character.
+/  The direct-index tables convert a character with two look-ups. Size of the tables
+/  is CP932: 67K/59K, CP936: 99K/174K, CP949: 115K/136K and CP950: 83K/108K bytes
+/  (direct/pair). */
+
+
+#define FF_DBCS_COMPACT	0
+/* This option switches the format of the conversion tables for DBCS code pages
+/  which are not selected by FF_DBCS_DIRECT.
+/
+/   0: Pair tables. A binary search on the code pairs is needed for every character.
+/   1: Range tables. The codes are stored in ranges of consecutive codes and it
+/      reduces size of the tables to CP932: 47K, CP936: 88K, CP949: 83K and
+/      CP950: 70K bytes. */
+
+
 #define FF_USE_LFN		0
 #define FF_MAX_LFN		255
 /* The FF_USE_LFN switches the support for LFN (long file name).
@@ -145,6 +207,14 @@
 /  When LFN is not enabled, this option has no effect. */
 
 
+#define FF_FAST_UPPER	0
+/* This option switches the implementation of the Unicode up-case conversion
+/  ff_wtoupper() which is used on every file name matching when LFN is enabled.
+/
+/   0: Compact run-length compressed table. It is decoded on every conversion.
+/   1: Two-level direct-index table. It takes about 5K bytes instead of 1K bytes. */
+
+
 #define FF_LFN_BUF		255
 #define FF_SFN_BUF		12
 /* This set of options defines size of file name members in the FILINFO structure
@@ -231,6 +301,141 @@
 /  buffer in the filesystem object (FATFS) is used for the file data transfer. */
 
 
+#define FF_FIL_BUF		1
+/* This option defines the size of the private data buffer in the file object (FIL)
+/  in unit of sector at non-tiny configuration. (>=1) Sequential writes in smaller
+/  chunks than the sector are collected in the buffer and written back to the volume
+/  with a multi-sector write when the buffer gets full or on f_sync(). A buffer of
+/  any size can also be given to each file by f_open_ex(). */
+
+
+#define FF_WIN_CACHE	0
+/* This option defines the number of sectors in the window cache. (0:Disable or >0)
+/  When enabled, sectors swapped out of the disk access window, FAT, directory and
+/  file data at the tiny configuration, are kept in the filesystem object (FATFS)
+/  and reused in LRU order. Dirty sectors are written back to the volume when they
+/  are evicted or on the sync process, such as f_sync() and f_close(). Every cache
+/  sector adds FF_MAX_SS bytes to the size of the filesystem object. */
+
+
+#define FF_FAT_CACHE	0
+/* This option defines the number of sectors in the FAT cache. (0:Disable or >0)
+/  When enabled, FAT and exFAT allocation bitmap are accessed through a dedicated
+/  LRU cache instead of the disk access window, so that following or allocating a
+/  cluster chain does not push out the directory sectors from the window. Dirty FAT
+/  sectors are written back to the both FATs when they are evicted or on the sync
+/  process. Every cache sector adds FF_MAX_SS bytes to the size of the filesystem
+/  object. */
+
+
+#define FF_LAZY_FAT2	0
+/* This option defines the number of FAT sectors whose reflection to the 2nd FAT
+/  can be deferred. (0:Disable or >0) When enabled, a FAT sector written back to
+/  the 1st FAT is registered to a pending list instead of being written to the 2nd
+/  FAT at the same time, and the listed sectors are reflected to the 2nd FAT in
+/  ascending order on the sync process, f_sync(), f_close() and unmount. When the
+/  list is full, the FAT sector is reflected immediately. This option has no effect
+/  on the volume with only one FAT. */
+
+
+#define FF_FREE_MAP		0
+/* This option defines the size of the free space map in unit of byte. (0:Disable
+/  or multiple of 4) When enabled, the clusters on the FAT12/16/32 volume are divided
+/  into groups and the free space map in the filesystem object (FATFS) has a bit per
+/  group which is cleared when the group is found to have no free cluster. Cluster
+/  allocation skips the groups known to be full without reading the FAT, so that it
+/  does not need to scan the FAT of a nearly full volume from end to end. The map is
+/  built lazily by the allocations and f_getfree(), and a group is marked again when
+/  a cluster in it is freed. This option has no effect on the exFAT volume. */
+
+
+#define FF_FREE_EXTENT	0
+/* This option defines the number of entries in the free extent index. (0:Disable
+/  or >0) When enabled, the filesystem object (FATFS) holds the longest contiguous
+/  free cluster blocks found in a scan of the FAT or exFAT allocation bitmap, and
+/  f_expand() allocates the shortest block that fits the request from the index
+/  instead of scanning the volume from the last allocated cluster. The index is
+/  kept up to date by the allocations and deallocations and rebuilt by f_expand()
+/  only when a block out of the index can fit the request. Every entry adds 8 bytes
+/  to the size of the filesystem object. This option has effect only when
+/  FF_USE_EXPAND == 1. */
+
+
+#define FF_CLST_RESERVE	0
+#define FF_CLST_RSV_FILES	8
+/* FF_CLST_RESERVE defines the number of clusters reserved ahead of the growing edge
+/  of a file open in write mode. (0:Disable or >0) When enabled, the allocation for
+/  the file opens a reservation window of this number of clusters at the allocated
+/  cluster and moves the allocation cursor past it. The other objects do not stretch
+/  their chains into the window, so that the files appended concurrently are laid
+/  out in runs of this size instead of being interleaved cluster by cluster. The
+/  window is held only in the filesystem object (FATFS) and the unused clusters are
+/  returned to the allocation cursor at f_close(). FF_CLST_RSV_FILES defines the
+/  number of files which can hold the window at a time on a volume. (>=1) */
+
+
+#define FF_READAHEAD	0
+/* This option defines the depth of the sequential read-ahead in unit of sector.
+/  (0:Disable or >=2) When enabled, f_read() detects the sequential access to the
+/  file data and prefetches the following sectors into the read-ahead buffer in the
+/  filesystem object (FATFS) with a multi-sector read, so that reading in small
+/  chunks is served from the memory. The prefetch does not go beyond the end of the
+/  file and a discontiguous cluster. It works at both normal and tiny configuration.
+/  The read-ahead buffer adds FF_READAHEAD * FF_MAX_SS bytes to the size of the
+/  filesystem object. */
+
+
+#define FF_DISK_VEC		0
+/* This option defines the maximum number of segments in a scatter-gather request
+/  to the disk I/O layer. (0:Disable or >=2) When enabled, the discontiguous sectors
+/  and buffers to be transferred at a time are passed to disk_readv()/disk_writev()
+/  in a request, such as the fragments and the partial last sector read by f_read(),
+/  the dirty file data and the fragments written by f_write() and the FAT sector
+/  written to the both FATs. When the disk I/O layer returns RES_PARERR, it is done
+/  with disk_read()/disk_write() segment by segment. */
+
+
+#define FF_DIR_INDEX	0
+/* This option defines the number of objects in the directory name index. (0:Disable
+/  or >0) When enabled, a directory on the FAT/FAT32 volume which took a lookup of
+/  more than a sector is indexed in the filesystem object (FATFS) with the hash values
+/  of the names and the locations of its objects, and subsequent lookups in it read
+/  and compare only the entries whose hash value matches the name to find. The index
+/  holds a directory at a time and it is kept up to date by creating, renaming and
+/  removing objects. A directory with more objects than this value is not indexed.
+/  Every object adds 8 bytes (4 bytes at non-LFN configuration) to the size of the
+/  filesystem object. This option has no effect on the exFAT volume. */
+
+
+#define FF_PATH_CACHE	0
+/* This option defines the number of entries in the path cache. (0:Disable or >0)
+/  When enabled, the segment names found or not found in following a path name are
+/  kept in the filesystem object (FATFS) with the location of the object in LRU
+/  order, so that opening objects in a deep directory tree does not need to search
+/  every directory in the path again. Only the names up to 15 characters on the
+/  FAT/FAT32 volume are cached. The cache is kept up to date by creating, renaming
+/  and removing objects. Every entry adds 53 bytes (28 bytes at non-LFN
+/  configuration) to the size of the filesystem object. */
+
+
+#define FF_SFN_FILTER	0
+/* This option defines the size of the SFN filter in unit of byte. (0:Disable or >0)
+/  When enabled, creating an object whose name is out of 8.3 format on the FAT/FAT32
+/  volume picks the numbered SFN (~N) with a bloom filter of the SFNs in the directory
+/  instead of searching the directory for every candidate. The filter is built with
+/  a scan of the directory and held in the filesystem object (FATFS) for a directory
+/  at a time. This option has effect only at LFN configuration. */
+
+
+#define FF_DIR_HINT		0
+/* This option defines the number of directories with the free entry hint. (0:Disable
+/  or 1-255) When enabled, the offset of the first free directory entry is held in the
+/  filesystem object (FATFS) for the recently extended directories, and allocation of
+/  directory entries on creating an object starts at the offset instead of the top of
+/  the directory. The hint is moved back when an object in the directory is removed.
+/  Every directory adds 8 bytes to the size of the filesystem object. */
+
+
 #define FF_FS_EXFAT		0
 /* This option switches support for exFAT filesystem. (0:Disable or 1:Enable)
 /  To enable exFAT, also LFN needs to be enabled. (FF_USE_LFN >= 1)